@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <time.h>
+
+// Timing harness for NanoDlpBench. Each benchmark times its own loops with
+// benchTime() and prints one line per variant through reportBench(), so the
+// numbers of two implementations can be read side by side.
+
+typedef void (*BenchFunction)(int argc, char ** argv);
+
+inline double benchTime() // Seconds on the monotonic clock
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Keeps the compiler from dropping a computation whose result is not used
+template<typename T>
+inline void benchKeep(const T & value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Prints the time per iteration of a loop that ran iterations times
+void reportBench(const char * bench, const char * variant, double seconds, size_t iterations, const char * unit);
+
+void benchGpio(int argc, char ** argv);
+void benchParse(int argc, char ** argv);
+void benchRamp(int argc, char ** argv);
+void benchStep(int argc, char ** argv);
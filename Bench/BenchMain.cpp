@@ -0,0 +1,49 @@
+#include "Bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct BenchEntry
+{
+    const char * name;
+    BenchFunction function;
+    const char * usage;
+};
+
+const BenchEntry BENCHES[] =
+{
+    { "gpio", benchGpio, "gpio [pin]  toggle a pin on the simulated registers, and on /dev/gpiomem and wiringPi if a free output pin is given" },
+    { "parse", benchParse, "parse       G-code lines through parseGCodeLine and through the parseInt/parseFloat lookups it replaced" },
+    { "ramp", benchRamp, "ramp        render an accelerating and decelerating move with the float and the fixed-point ramp" },
+    { "step", benchStep, "step        step and direction masks and whole executor steps with run-time and with compiled-in pins" },
+};
+
+void reportBench(const char * bench, const char * variant, double seconds, size_t iterations, const char * unit)
+{
+    printf("%-8s %-24s %10.2f ns/%s\n", bench, variant, seconds * 1e9 / iterations, unit);
+    fflush(stdout);
+}
+
+// NanoDlpBench runs every benchmark, NanoDlpBench <name> [args] just one
+int main(int argc, char ** argv)
+{
+    const char * only = argc > 1 ? argv[1] : NULL;
+    bool found = false;
+    for(size_t i = 0; i < sizeof(BENCHES) / sizeof(BENCHES[0]); i++)
+    {
+        if(only != NULL && strcmp(only, BENCHES[i].name) != 0)
+            continue;
+
+        BENCHES[i].function(only != NULL ? argc - 2 : 0, argv + 2);
+        found = true;
+    }
+
+    if(!found)
+    {
+        fprintf(stderr, "Usage: %s [name [args]]\n", argv[0]);
+        for(size_t i = 0; i < sizeof(BENCHES) / sizeof(BENCHES[0]); i++)
+            fprintf(stderr, "  %s\n", BENCHES[i].usage);
+        return 1;
+    }
+    return 0;
+}
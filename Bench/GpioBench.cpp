@@ -0,0 +1,52 @@
+#include "Bench.h"
+#include "Gpio.h"
+#include "Config.h"
+
+#include <wiringPi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace
+{
+
+void timeToggles(Gpio::Backend backend, const char * variant, int pin, size_t toggles)
+{
+    Gpio gpio;
+    if(!gpio.open(backend))
+    {
+        printf("gpio     %-24s cannot map /dev/gpiomem\n", variant);
+        return;
+    }
+
+    // One step pulse: the pin goes high, then low
+    uint32_t mask = Gpio::maskOf(pin);
+    double start = benchTime();
+    for(size_t i = 0; i < toggles; i++)
+    {
+        gpio.write(mask, 0);
+        gpio.write(0, mask);
+    }
+    reportBench("gpio", variant, benchTime() - start, toggles, "pulse");
+}
+
+}
+
+void benchGpio(int argc, char ** argv) // gpio [pin]
+{
+    timeToggles(Gpio::GPIO_SIMULATED, "simulated", STEP_PIN, 20000000);
+
+    // Real pins are only touched when named, the step pin would move the motor
+    if(argc < 1)
+        return;
+
+    int pin = atoi(argv[0]);
+    if(wiringPiSetupGpio() == -1)
+    {
+        printf("gpio     cannot initialize wiringPi\n");
+        return;
+    }
+    pinMode(pin, OUTPUT);
+
+    timeToggles(Gpio::GPIO_GPIOMEM, "gpiomem", pin, 20000000);
+    timeToggles(Gpio::GPIO_WIRINGPI, "wiringPi", pin, 2000000);
+}
@@ -0,0 +1,149 @@
+#include "Bench.h"
+#include "GCodeCommand.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace
+{
+
+// Lines as NanoDLP sends them, with the words their handlers read
+struct BenchLine
+{
+    const char * line;
+    const char * words;
+};
+
+const BenchLine LINES[] =
+{
+    { "G1 Z5 F300", "ZF" },
+    { "G1 Z-4.95 F150", "ZF" },
+    { "G1 Z0.05 F60", "ZF" },
+    { "G4 P2000", "P" },
+    { "M106 P1 S255", "PS" },
+    { "M3", "" },
+    { "M5", "" },
+    { "G90", "" },
+};
+const size_t LINE_COUNT = sizeof(LINES) / sizeof(LINES[0]);
+
+// The parser this replaced: each word lookup rescans the line from the
+// start, and the line arrived as a std::string of its own
+int legacyParseInt(const char * buf, char prefix, int value)
+{
+    const char * ptr = buf;
+    while(ptr && *ptr)
+    {
+        if(*ptr == prefix)
+            return atoi(ptr + 1);
+
+        ptr = strchr(ptr, ' ');
+        if(ptr == NULL)
+            break;
+        ptr++;
+    }
+    return value;
+}
+
+float legacyParseFloat(const char * buf, char prefix, float value)
+{
+    const char * ptr = buf;
+    while(ptr && *ptr)
+    {
+        if(*ptr == prefix)
+            return atof(ptr + 1);
+
+        ptr = strchr(ptr, ' ');
+        if(ptr == NULL)
+            break;
+        ptr++;
+    }
+    return value;
+}
+
+bool legacyCheckMCommand(const char * buf, char prefix)
+{
+    return strchr(buf, prefix) != NULL;
+}
+
+float legacyParse(const BenchLine & benchLine)
+{
+    std::string line(benchLine.line);
+    const char * cmd = line.c_str();
+
+    float sum = legacyParseInt(cmd, cmd[0], 0);
+    for(const char * word = benchLine.words; *word; word++)
+    {
+        if(*word == 'P' && cmd[0] == 'M')
+            sum += legacyCheckMCommand(cmd, 'P');
+        else
+            sum += legacyParseFloat(cmd, *word, 0);
+    }
+    return sum;
+}
+
+float tokenizerParse(const BenchLine & benchLine)
+{
+    GCodeCommand cmd;
+    if(!parseGCodeLine(benchLine.line, cmd))
+        return 0;
+
+    float sum = cmd.code;
+    for(const char * word = benchLine.words; *word; word++)
+        sum += cmd.getFloat(*word, 0);
+    return sum;
+}
+
+void timeLines(const char * variant, float (*parse)(const BenchLine &), size_t rounds)
+{
+    float sum = 0;
+    double start = benchTime();
+    for(size_t round = 0; round < rounds; round++)
+    {
+        for(size_t i = 0; i < LINE_COUNT; i++)
+            sum += parse(LINES[i]);
+        benchKeep(sum);
+    }
+    reportBench("parse", variant, benchTime() - start, rounds * LINE_COUNT, "line");
+}
+
+const char * const NUMBERS[] = { "5", "-4.95", "0.05", "300", "2000", "255", "12.5", "0.0125" };
+const size_t NUMBER_COUNT = sizeof(NUMBERS) / sizeof(NUMBERS[0]);
+
+void timeNumbers(size_t rounds)
+{
+    float sum = 0;
+    double start = benchTime();
+    for(size_t round = 0; round < rounds; round++)
+    {
+        for(size_t i = 0; i < NUMBER_COUNT; i++)
+            sum += atof(NUMBERS[i]);
+        benchKeep(sum);
+    }
+    reportBench("parse", "atof", benchTime() - start, rounds * NUMBER_COUNT, "number");
+
+    start = benchTime();
+    for(size_t round = 0; round < rounds; round++)
+    {
+        for(size_t i = 0; i < NUMBER_COUNT; i++)
+        {
+            const char * ptr = NUMBERS[i];
+            float value = 0;
+            parseGCodeNumber(ptr, value);
+            sum += value;
+        }
+        benchKeep(sum);
+    }
+    reportBench("parse", "parseGCodeNumber", benchTime() - start, rounds * NUMBER_COUNT, "number");
+}
+
+}
+
+void benchParse(int, char **) // parse
+{
+    const size_t ROUNDS = 1000000;
+    timeLines("parseInt/parseFloat", legacyParse, ROUNDS);
+    timeLines("parseGCodeLine", tokenizerParse, ROUNDS);
+    timeNumbers(ROUNDS);
+}
@@ -0,0 +1,33 @@
+#include "Bench.h"
+#include "../Tests/RampRender.h"
+#include "Config.h"
+
+#include <math.h>
+
+namespace
+{
+
+void timeRamp(const char * variant, size_t (*render)(const RampMove &, std::vector<uint32_t> *), const RampMove & move, int repeats)
+{
+    size_t steps = 0;
+    double start = benchTime();
+    for(int i = 0; i < repeats; i++)
+        steps += render(move, NULL);
+    reportBench("ramp", variant, benchTime() - start, steps, "step");
+}
+
+}
+
+void benchRamp(int, char **) // ramp
+{
+    // Slow enough to ramp for the whole move, so every step runs the Leib update
+    RampMove move;
+    move.distance = lround(5 * STEPS_PER_MM);
+    move.speed = 20 * STEPS_PER_MM;
+    move.acceleration = 5 * STEPS_PER_MM;
+    move.entrySpeed = 0;
+    move.exitSpeed = 0;
+
+    timeRamp("float", renderFloatRamp, move, 20);
+    timeRamp("fixed point", renderFixedRamp, move, 20);
+}
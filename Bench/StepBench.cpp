@@ -0,0 +1,94 @@
+#include "Bench.h"
+#include "StepExecutor.h"
+#include "Config.h"
+
+#include <stdlib.h>
+
+namespace
+{
+
+const size_t EVENT_COUNT = 4096;
+
+// Random steps and directions of the configured axes
+void makeEvents(StepEvent * events)
+{
+    srand(1);
+    uint32_t axisMask = (1u << (AUX_AXIS_COUNT + 1)) - 1;
+    for(size_t i = 0; i < EVENT_COUNT; i++)
+    {
+        uint32_t steps = (rand() & axisMask) | 1;
+        uint32_t directions = rand() & axisMask;
+        events[i].intervalInUS = 0;
+        events[i].flags = steps * STEP_EVENT_STEP | directions * STEP_EVENT_DIRECTION;
+    }
+}
+
+template<typename Pins>
+void timeMasks(const char * variant, const Pins & pins, const StepEvent * events, size_t rounds)
+{
+    uint32_t sum = 0;
+    double start = benchTime();
+    for(size_t round = 0; round < rounds; round++)
+    {
+        for(size_t i = 0; i < EVENT_COUNT; i++)
+        {
+            uint32_t setMask, clearMask;
+            pins.directionMasks(events[i].flags & STEP_EVENT_DIRECTIONS, setMask, clearMask);
+            sum += pins.stepMask(events[i].flags & STEP_EVENT_STEPS) + setMask + clearMask;
+        }
+        benchKeep(sum);
+    }
+    reportBench("step", variant, benchTime() - start, rounds * EVENT_COUNT, "step");
+}
+
+// Whole steps through the executor on the simulated registers, pulse width included
+template<typename Executor>
+void timeExecutor(const char * variant, const StepEvent * events, size_t rounds)
+{
+    StepBuffer buffer;
+    Gpio gpio;
+    gpio.open(Gpio::GPIO_SIMULATED);
+    Executor executor(buffer, gpio);
+    executor.connectToPins(STEP_PIN, DIR_PIN);
+    for(int axis = 1; axis <= AUX_AXIS_COUNT; axis++)
+        executor.connectAxis(axis, AUX_STEP_PINS[axis - 1], AUX_DIR_PINS[axis - 1], AUX_INVERT_DIR[axis - 1]);
+
+    double start = benchTime();
+    for(size_t round = 0; round < rounds; round++)
+    {
+        for(size_t i = 0; i < EVENT_COUNT; i++)
+        {
+            buffer.push(events[i]);
+            if(buffer.full())
+            {
+                while(!executor.process())
+                    ;
+            }
+        }
+    }
+    while(!executor.process())
+        ;
+    reportBench("step", variant, benchTime() - start, rounds * EVENT_COUNT, "step");
+}
+
+}
+
+void benchStep(int, char **) // step
+{
+    static StepEvent events[EVENT_COUNT];
+    makeEvents(events);
+
+    RuntimeStepPins runtimePins;
+    runtimePins.connect(0, STEP_PIN, DIR_PIN, INVERT_DIR);
+    for(int axis = 1; axis <= AUX_AXIS_COUNT; axis++)
+        runtimePins.connect(axis, AUX_STEP_PINS[axis - 1], AUX_DIR_PINS[axis - 1], AUX_INVERT_DIR[axis - 1]);
+    timeMasks("masks, run-time pins", runtimePins, events, 5000);
+#if FIXED_STEP_PINS
+    timeMasks("masks, fixed pins", ConfigStepPins(), events, 5000);
+#endif
+
+    timeExecutor<DynamicStepExecutor>("executor, run-time pins", events, 50);
+#if FIXED_STEP_PINS
+    timeExecutor<BasicStepExecutor<ConfigStepPins> >("executor, fixed pins", events, 50);
+#endif
+}
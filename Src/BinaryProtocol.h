@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+// Optional fixed-layout framing for tools that poll or script the shield at a
+// high rate. A channel switches to it with "M1000", which is already answered
+// with a BINARY_OK frame, and back to text with an M1000 S0 request frame,
+// answered with "ok". Fields are little endian, as on the Pi. Every frame
+// starts with BINARY_SYNC so a reader can resync.
+
+const uint8_t BINARY_SYNC = 0xA5;
+const int BINARY_MAX_WORDS = 4;
+
+#pragma pack(push, 1)
+
+// One G or M command, dispatched exactly like the equivalent text line
+struct BinaryRequest
+{
+    uint8_t sync;                           // BINARY_SYNC
+    uint8_t letter;                         // 'G' or 'M'
+    uint16_t code;
+    uint16_t seq;                           // echoed back in every response
+    uint8_t wordCount;                      // valid entries in the arrays below
+    uint8_t reserved;
+    char wordLetters[BINARY_MAX_WORDS];
+    float wordValues[BINARY_MAX_WORDS];
+};
+
+enum BinaryStatus
+{
+    BINARY_OK = 0,              // command accepted ("ok")
+    BINARY_INVALID = 1,         // invalid or unsupported command
+    BINARY_MOVE_COMPLETE = 2,   // move finished ("Z_move_comp")
+    BINARY_POSITION = 3         // answer to M114
+};
+
+// Every response carries a snapshot of the axis with full float precision
+struct BinaryResponse
+{
+    uint8_t sync;                           // BINARY_SYNC
+    uint8_t status;                         // BinaryStatus
+    uint16_t seq;                           // seq of the request this answers
+    float positionInMillimeters;
+    float velocityInMillimetersPerSecond;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(BinaryRequest) == 28, "BinaryRequest layout changed");
+static_assert(sizeof(BinaryResponse) == 12, "BinaryResponse layout changed");
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+
+// Fixed-capacity FIFO used to hold commands that were already received and
+// validated but have to wait for the motion in front of them to finish.
+// N must be a power of two, head and tail run freely and are masked on use.
+template<typename T, size_t N>
+class CommandQueue
+{
+    static_assert((N & (N - 1)) == 0, "CommandQueue size must be a power of two");
+
+    T _items[N];
+    size_t _head;
+    size_t _tail;
+
+public:
+    CommandQueue()
+        : _head(0)
+        , _tail(0)
+    {}
+
+    bool empty() const { return _head == _tail; }
+    bool full() const { return _tail - _head == N; }
+    size_t size() const { return _tail - _head; }
+
+    // Returns the slot to fill in, or NULL if the queue is full
+    T * push()
+    {
+        if(full())
+            return NULL;
+        return &_items[_tail++ & (N - 1)];
+    }
+
+    T & front() { return _items[_head & (N - 1)]; }
+    T & back() { return _items[(_tail - 1) & (N - 1)]; }
+
+    // i-th item from the front
+    T & operator[](size_t i) { return _items[(_head + i) & (N - 1)]; }
+
+    void pop() { _head++; }
+    void clear() { _head = _tail; }
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "GCodeCommand.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Registry of supported G and M commands. The table itself is a constexpr
+// array in Commands.h; per-letter index arrays are generated from it
+// at compile time, so dispatch is a bounds check and two array loads, and
+// a command registered twice fails the build.
+
+typedef void (*CommandHandler)(const GCodeCommand & cmd);
+
+struct CommandEntry
+{
+    char letter;
+    int code;
+    CommandHandler handler;
+    bool immediate;         // run on arrival instead of waiting in the command queue
+    bool overtakes;         // immediate, and also taken ahead of lines waiting for queue space
+};
+
+// Maps a code to its position in the table plus one, zero if unsupported
+template<int MaxCode>
+struct CommandIndex
+{
+    uint8_t slot[MaxCode + 1];
+
+    const CommandEntry * find(const CommandEntry * table, int code) const
+    {
+        if(code < 0 || code > MaxCode || slot[code] == 0)
+            return NULL;
+        return &table[slot[code] - 1];
+    }
+};
+
+template<int MaxCode, size_t N>
+constexpr CommandIndex<MaxCode> buildCommandIndex(const CommandEntry (&table)[N], char letter)
+{
+    static_assert(N < 255, "Command table too large for an 8-bit index");
+
+    CommandIndex<MaxCode> index = {};
+    for(size_t i = 0; i < N; i++)
+    {
+        if(table[i].letter == letter)
+            index.slot[table[i].code] = (uint8_t)(i + 1);
+    }
+    return index;
+}
+
+template<size_t N>
+constexpr bool hasDuplicateCommands(const CommandEntry (&table)[N])
+{
+    for(size_t i = 0; i < N; i++)
+    {
+        for(size_t j = i + 1; j < N; j++)
+        {
+            if(table[i].letter == table[j].letter && table[i].code == table[j].code)
+                return true;
+        }
+    }
+    return false;
+}
+
+template<size_t N>
+constexpr bool commandsInRange(const CommandEntry (&table)[N], char letter, int maxCode)
+{
+    for(size_t i = 0; i < N; i++)
+    {
+        if(table[i].letter == letter && (table[i].code < 0 || table[i].code > maxCode))
+            return false;
+    }
+    return true;
+}
+
+template<size_t N>
+constexpr bool overtakingCommandsImmediate(const CommandEntry (&table)[N])
+{
+    for(size_t i = 0; i < N; i++)
+    {
+        if(table[i].overtakes && !table[i].immediate)
+            return false;
+    }
+    return true;
+}
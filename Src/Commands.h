@@ -0,0 +1,90 @@
+#pragma once
+
+#include "CommandTable.h"
+
+// Every command the shield supports. PrintTime registers the same table with
+// its own handlers, so both accept, queue and record a job's commands alike.
+// Adding a command takes a handler in each and a line here.
+
+void handleMove(const GCodeCommand & cmd);
+void handlePause(const GCodeCommand & cmd);
+void handleHome(const GCodeCommand & cmd);
+void handleAbsolutePositioning(const GCodeCommand & cmd);
+void handleRelativePositioning(const GCodeCommand & cmd);
+void handleLEDOn(const GCodeCommand & cmd);
+void handleLEDOff(const GCodeCommand & cmd);
+void handleMotorOn(const GCodeCommand & cmd);
+void handleMotorOff(const GCodeCommand & cmd);
+void handleFanOrLEDOn(const GCodeCommand & cmd);
+void handleFanOrLEDOff(const GCodeCommand & cmd);
+void handleEmergencyStop(const GCodeCommand & cmd);
+void handleGetPosition(const GCodeCommand & cmd);
+void handleResume(const GCodeCommand & cmd);
+void handleFeedHold(const GCodeCommand & cmd);
+void handleRunFile(const GCodeCommand & cmd);
+void handleSetJerk(const GCodeCommand & cmd);
+void handleBuzzer(const GCodeCommand & cmd);
+void handleAbort(const GCodeCommand & cmd);
+void handleRecordMacro(const GCodeCommand & cmd);
+void handleEndMacro(const GCodeCommand & cmd);
+void handleReplayMacro(const GCodeCommand & cmd);
+void handlePeel(const GCodeCommand & cmd);
+void handleStepRate(const GCodeCommand & cmd);
+void handleBinaryMode(const GCodeCommand & cmd);
+
+constexpr CommandEntry COMMAND_TABLE[] =
+{
+    // letter, code, handler, immediate, overtakes
+    { 'G', 1, handleMove, false, false },
+    { 'G', 4, handlePause, false, false },
+    { 'G', 28, handleHome, false, false },
+    { 'G', 90, handleAbsolutePositioning, false, false },
+    { 'G', 91, handleRelativePositioning, false, false },
+
+    { 'M', 3, handleLEDOn, false, false },
+    { 'M', 5, handleLEDOff, false, false },
+    { 'M', 17, handleMotorOn, false, false },
+    { 'M', 18, handleMotorOff, false, false },
+    { 'M', 106, handleFanOrLEDOn, false, false },
+    { 'M', 107, handleFanOrLEDOff, false, false },
+    { 'M', 112, handleEmergencyStop, true, true },
+    { 'M', 114, handleGetPosition, true, true },
+    { 'M', 24, handleResume, true, true },
+    { 'M', 25, handleFeedHold, true, true },
+    { 'M', 32, handleRunFile, true, false },
+    { 'M', 205, handleSetJerk, false, false },
+    { 'M', 300, handleBuzzer, false, false },
+    { 'M', 410, handleAbort, true, true },
+    { 'M', 800, handleRecordMacro, true, false },
+    { 'M', 801, handleEndMacro, true, false },
+    { 'M', 802, handleReplayMacro, false, false },
+    { 'M', 810, handlePeel, false, false },
+    { 'M', 850, handleStepRate, false, false },
+    { 'M', 1000, handleBinaryMode, true, false },
+};
+
+const int MAX_G_CODE = 99;
+const int MAX_M_CODE = 1023;
+
+static_assert(!hasDuplicateCommands(COMMAND_TABLE), "Command registered twice in COMMAND_TABLE");
+static_assert(commandsInRange(COMMAND_TABLE, 'G', MAX_G_CODE), "G code above MAX_G_CODE");
+static_assert(commandsInRange(COMMAND_TABLE, 'M', MAX_M_CODE), "M code above MAX_M_CODE");
+static_assert(MAX_M_CODE <= GCODE_MAX_CODE, "M codes above GCODE_MAX_CODE cannot be parsed");
+static_assert(overtakingCommandsImmediate(COMMAND_TABLE), "Only immediate commands can overtake queued lines");
+
+constexpr CommandIndex<MAX_G_CODE> G_COMMANDS = buildCommandIndex<MAX_G_CODE>(COMMAND_TABLE, 'G');
+constexpr CommandIndex<MAX_M_CODE> M_COMMANDS = buildCommandIndex<MAX_M_CODE>(COMMAND_TABLE, 'M');
+
+inline const CommandEntry * findCommand(const GCodeCommand & cmd) // NULL if the command is not supported
+{
+    switch(cmd.letter)
+    {
+    case 'G':
+        return G_COMMANDS.find(COMMAND_TABLE, cmd.code);
+
+    case 'M':
+        return M_COMMANDS.find(COMMAND_TABLE, cmd.code);
+    }
+
+    return NULL;
+}
@@ -76,6 +76,14 @@ const int DIR_PIN = 5;    //Jumpers connect this to endstop output if using 5160
 const int VCC_PIN = 27;
 const int STEP_PIN = 6;   //Jumpers connect this to endstop output if using 5160 ramp mode
 const int ENABLE_PIN = 12;
+const bool INVERT_DIR = false;  // true if Z moves the wrong way, the direction pin is then low for negative moves
+// Set to 1 to compile the step and direction pins above into the step executor, so each step writes
+// precomputed masks. 0 keeps them run-time settings.
+#define FIXED_STEP_PINS 1
+// How step, direction and enable are driven: 0 = wiringPi, 1 = the GPIO registers mapped from /dev/gpiomem
+// (fastest, one store per edge), 2 = simulated registers for running without a Pi. Overridden by --gpio.
+const int GPIO_BACKEND = 1;
+const int STEP_PULSE_US = 2;  // extra step pulse width; DRV8825 and A4988 need 2, TMC22xx can use 0
 const int STEPS_PER_REV = 200; //Set steps/rev of motor. 200 for 1.8* 400 for .9* NEMA17
 const int MICROSTEP_SET = 256; //Set your chosen microstepping of your driver to match the jumpers on the board.  If SPI, this is SW set.
 const int LEAD_LEN = 2; // set leadscrew lead length in mm/rev
@@ -83,6 +91,42 @@ const float STEPS_PER_MM = STEPS_PER_REV*MICROSTEP_SET/LEAD_LEN; //calculate ste
 const float DEFAULT_SPEED = 2; // Set the 'default' speed that will be used if no speed (G1 Zxx) is provided in mm/s 
 const float DEFAULT_ACCELERATION = 600; // set default accelerations in mm/s^2.
 
+// Jerk in mm/s^3 for S-curve moves, whose acceleration ramps up and down instead of switching on and off.
+// Smoother lifts are gentler on the FEP, so the acceleration can be raised. 0 keeps trapezoidal moves.
+// Try 20000 with DEFAULT_ACCELERATION 600. Can be changed with M205 Jnnn, or per move with G1 ... Jnnn.
+const float DEFAULT_JERK = 0;
+
+// Set to 1 to compute the acceleration ramp with integer math instead of floats. Step periods match the
+// float ramp to within 1us, and to within 100us over the last 300 steps before coming to rest, and whole
+// moves take the same time to within 0.25% (Tests/RampTest.cpp). Periods over 1 second are clamped.
+#define RAMP_FIXED_POINT 1
+
+// Set to 1 to measure at startup how many steps/s can actually be produced, with the driver disabled.
+// Faster G1, homing and button speeds are clamped to STEP_RATE_MARGIN of that instead of silently
+// running slower than commanded. M850 reports the limits, M850 S1 measures them again.
+#define STEP_RATE_PROBE 1
+const float STEP_RATE_MARGIN = 0.9;
+
+// Number of M800 macros and how many commands each can hold
+const int MACRO_COUNT = 8;
+const int MACRO_LENGTH = 16;
+
+//___________________________________________________________________________________________________________________________________________
+//////// Auxiliary axes ///////////////
+/*
+Tilt-peel vats and wipers can run up to two more stepper drivers in step with Z, wired to free pins of the
+breakout header. They share ENABLE_PIN with Z. Each axis is moved with its letter in G1, e.g. G1 Z5 A-3 F300.
+All axes in a G1 start and finish together. F is the speed of the axis that travels farthest, in mm/min or
+degrees/min of its own. Steps per unit are steps/mm for a linear axis, steps/degree for a tilt.
+Set AUX_AXIS_COUNT to the number of drivers connected, 0 for Z only.
+*/
+#define AUX_AXIS_COUNT 0
+const char AUX_AXIS_LETTERS[] = { 'A', 'B' };
+const int AUX_STEP_PINS[] = { 22, 24 };
+const int AUX_DIR_PINS[] = { 23, 18 };
+const float AUX_STEPS_PER_UNIT[] = { 3200, 3200 };
+const bool AUX_INVERT_DIR[] = { false, false };
+
 //___________________________________________________________________________________________________________________________________________
 //////// Manual Movement BUttons ///////////////
 /*
@@ -135,6 +179,12 @@ const int Z_STOP_PIN = 26;
 //Pull UP/DN for limit switches. (PUD 2 = pull UP) (PUD 1 = pull DN)
 const int Z_STOP_PUD = 1;
 
+// Set to 1 to watch both endstops through GPIO edge interrupts during every move, not only while homing.
+// A closed switch stops moves toward it within a step and is reported with its time and position.
+#define ENDSTOP_MONITOR 1
+const int Z_MIN_STOP_PIN = 26; // bottom
+const int Z_MAX_STOP_PIN = 16; // top
+
 
 //________________________________________________________________________________________________________________________________________
 ////////  Homing parameters. for the Z-axis ///////////////
@@ -165,6 +215,32 @@ const int LED_ON_BTN_PUD = 1; // PUD_DN
 #endif //SUPPORT_LED_ON_BUTTON
 
 
+//________________________________________________________________________________________________________________________________________
+//////// Motion thread ///////////////
+/*
+Steps are taken on their own thread with real-time (SCHED_FIFO) priority, so pty traffic, logging or a slow SD card
+cannot delay them. Real-time priority and memory locking need root; without it the thread runs at normal priority.
+For the steadiest timing reserve a core for it: add isolcpus=3 to /boot/cmdline.txt and set MOTION_THREAD_CPU to 3.
+Pinned this way the thread spins through the last 100us before each step. -1 lets the kernel choose, and the thread
+then sleeps through all but the last 20us, so it leaves a shared core to the main loop even at high step rates. Set MOTION_THREAD to 0 to take steps from the main loop instead.
+*/
+#define MOTION_THREAD 1
+const int MOTION_THREAD_PRIORITY = 80;
+const int MOTION_THREAD_CPU = -1;
+
+
+//________________________________________________________________________________________________________________________________________
+//////// Logging ///////////////
+/*
+Log messages are written to stdout (the terminal or journald) from a background thread.
+LOG_LEVEL selects the least important messages that are kept:
+0 = debug (every received and sent line), 1 = info, 2 = warnings, 3 = errors only.
+Set ENABLE_LOGGING to 0 to compile all logging out.
+*/
+#define ENABLE_LOGGING 1
+#define LOG_LEVEL 0
+
+
 //________________________________________________________________________________________________________________________________________
 //////// Constants ///////////////
 
@@ -0,0 +1,84 @@
+#include "ControlSocket.h"
+#include "Log.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdexcept>
+
+using namespace std;
+
+ControlSocket::ControlSocket(EventLoop & loop, const string & path, int firstId)
+    : _loop(loop)
+    , _path(path)
+    , _nextId(firstId)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Control socket path too long");
+    strcpy(addr.sun_path, path.c_str());
+
+    _listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(_listen < 0)
+        throw std::runtime_error("Cannot create control socket");
+
+    unlink(path.c_str());
+    if(bind(_listen, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(_listen, MAX_CLIENTS) < 0)
+        throw std::runtime_error("Cannot bind control socket");
+
+    LOG_INFO("Control socket: %s", path.c_str());
+    _loop.add(_listen, this);
+}
+
+ControlSocket::~ControlSocket()
+{
+    _clients.clear();
+    _loop.remove(_listen);
+    close(_listen);
+    unlink(_path.c_str());
+}
+
+void ControlSocket::onEvent(uint32_t events)
+{
+    (void)events;
+
+    for(;;)
+    {
+        int fd = accept4(_listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0)
+            break;
+
+        if(_clients.size() >= MAX_CLIENTS)
+        {
+            LOG_WARN("Control socket full, rejecting client");
+            close(fd);
+            continue;
+        }
+
+        _clients.emplace_back(new LineChannel(_loop, fd, _nextId++));
+    }
+}
+
+void ControlSocket::reap()
+{
+    for(size_t i = 0; i < _clients.size(); )
+    {
+        if(_clients[i]->isClosed() && !_clients[i]->hasPendingInput())
+            _clients.erase(_clients.begin() + i);
+        else
+            i++;
+    }
+}
+
+LineChannel * ControlSocket::find(int id)
+{
+    for(size_t i = 0; i < _clients.size(); i++)
+    {
+        if(_clients[i]->id() == id)
+            return _clients[i].get();
+    }
+    return NULL;
+}
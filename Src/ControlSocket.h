@@ -0,0 +1,34 @@
+#pragma once
+
+#include "LineChannel.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+// Unix-domain stream socket that accepts the same text commands as the pty,
+// so monitoring tools do not have to share the pty with NanoDLP.
+class ControlSocket : public EventLoop::Handler
+{
+    static const size_t MAX_CLIENTS = 8;
+
+    EventLoop & _loop;
+    int _listen;
+    std::string _path;
+    int _nextId;
+    std::vector<std::unique_ptr<LineChannel> > _clients;
+
+public:
+    // Client channels are numbered from firstId upwards
+    ControlSocket(EventLoop & loop, const std::string & path, int firstId);
+    ~ControlSocket();
+
+    void onEvent(uint32_t events);
+
+    // Drops clients that disconnected and have nothing left to consume
+    void reap();
+
+    size_t clientCount() const { return _clients.size(); }
+    LineChannel & client(size_t index) { return *_clients[index]; }
+    LineChannel * find(int id);
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "StepBuffer.h"
+
+#include <stdlib.h>
+
+// Steps several axes along one rendered move. The ramp is rendered for the
+// lead axis, the one with the most steps, and each of its steps advances the
+// others by their share, Bresenham style. All axes start and finish together
+// and keep their ratio throughout, with integer maths only.
+class CoordinatedAxes
+{
+public:
+    CoordinatedAxes()
+        : _leadSteps(0)
+        , _directions(0)
+    {}
+
+    // Signed distance of each axis in steps
+    void setup(const long * distances)
+    {
+        _leadSteps = 0;
+        _directions = 0;
+        for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        {
+            _distances[axis] = labs(distances[axis]);
+            if(distances[axis] < 0)
+                _directions |= STEP_EVENT_DIRECTION << axis;
+            if(_distances[axis] > _leadSteps)
+                _leadSteps = _distances[axis];
+        }
+
+        // Starting half way spreads the steps of the slower axes evenly
+        for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+            _errors[axis] = _leadSteps / 2;
+    }
+
+    long getLeadSteps() const { return _leadSteps; }
+
+    // Flags of the next step of the lead axis
+    uint32_t nextStepFlags()
+    {
+        uint32_t flags = _directions;
+        for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        {
+            _errors[axis] += _distances[axis];
+            if(_errors[axis] >= _leadSteps)
+            {
+                _errors[axis] -= _leadSteps;
+                flags |= STEP_EVENT_STEP << axis;
+            }
+        }
+        return flags;
+    }
+
+private:
+    long _leadSteps;
+    uint32_t _directions;
+    long _distances[STEP_EVENT_AXES];
+    long _errors[STEP_EVENT_AXES];
+};
@@ -0,0 +1,87 @@
+#include "Endstops.h"
+#include "Config.h"
+
+#include <wiringPi.h>
+#include <atomic>
+
+namespace
+{
+
+struct Endstop
+{
+    int pin;
+    uint32_t blocks;                // direction of travel it stops
+    std::atomic<bool> pending;      // trip written and not taken yet
+    EndstopTrip trip;
+};
+
+Endstop endstops[] =
+{
+    { Z_MIN_STOP_PIN, StepExecutor::BLOCK_NEGATIVE, { false }, {} },
+    { Z_MAX_STOP_PIN, StepExecutor::BLOCK_POSITIVE, { false }, {} },
+};
+
+StepExecutor * monitoredExecutor = NULL;
+
+// Active high switches are pulled down, active low ones up, as for homing
+bool isClosed(const Endstop & endstop)
+{
+    return digitalRead(endstop.pin) == (Z_STOP_PUD == 1 ? HIGH : LOW);
+}
+
+// Runs on wiringPi's interrupt thread for the pin
+void handleEdge(Endstop & endstop)
+{
+    unsigned long now_InUS = micros();
+    bool closed = isClosed(endstop);
+    monitoredExecutor->setBlocked(endstop.blocks, closed);
+
+    if(closed && !endstop.pending.load(std::memory_order_acquire))
+    {
+        endstop.trip.pin = endstop.pin;
+        endstop.trip.time_InUS = now_InUS;
+        endstop.trip.positionInSteps = monitoredExecutor->getPositionInSteps();
+        endstop.pending.store(true, std::memory_order_release);
+    }
+}
+
+void handleMinEdge()
+{
+    handleEdge(endstops[0]);
+}
+
+void handleMaxEdge()
+{
+    handleEdge(endstops[1]);
+}
+
+}
+
+bool startEndstopMonitor(StepExecutor & executor)
+{
+    monitoredExecutor = &executor;
+
+    for(Endstop & endstop : endstops)
+    {
+        pinMode(endstop.pin, INPUT);
+        pullUpDnControl(endstop.pin, Z_STOP_PUD);
+        executor.setBlocked(endstop.blocks, isClosed(endstop));
+    }
+
+    return wiringPiISR(endstops[0].pin, INT_EDGE_BOTH, handleMinEdge) >= 0 &&
+           wiringPiISR(endstops[1].pin, INT_EDGE_BOTH, handleMaxEdge) >= 0;
+}
+
+bool takeEndstopTrip(EndstopTrip & trip)
+{
+    for(Endstop & endstop : endstops)
+    {
+        if(endstop.pending.load(std::memory_order_acquire))
+        {
+            trip = endstop.trip;
+            endstop.pending.store(false, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
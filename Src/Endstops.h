@@ -0,0 +1,21 @@
+#pragma once
+
+#include "StepExecutor.h"
+
+// A switch closing, as seen by its edge interrupt
+struct EndstopTrip
+{
+    int pin;
+    unsigned long time_InUS;    // micros() in the interrupt
+    long positionInSteps;       // executor position at that moment
+};
+
+// Watches the bottom and top endstops through GPIO edge interrupts during
+// every move. While a switch is closed the executor drops steps toward it, so
+// a move into it ends within a step of the interrupt instead of whenever a
+// loop next reads the pin. Returns false if the interrupts cannot be set up.
+bool startEndstopMonitor(StepExecutor & executor);
+
+// Takes a trip that has not been reported yet, false if there is none. Only
+// the first trip of each switch is kept until it is taken.
+bool takeEndstopTrip(EndstopTrip & trip);
@@ -0,0 +1,56 @@
+#include "EventLoop.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <stdexcept>
+
+EventLoop::EventLoop()
+{
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+    if(_epoll < 0)
+        throw std::runtime_error("Cannot create epoll instance");
+}
+
+EventLoop::~EventLoop()
+{
+    close(_epoll);
+}
+
+void EventLoop::add(int fd, Handler * handler)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = handler;
+    if(epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+        throw std::runtime_error("Cannot add descriptor to epoll");
+}
+
+void EventLoop::watch(int fd, Handler * handler, bool readable, bool writable)
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    if(readable)
+        ev.events |= EPOLLIN;
+    if(writable)
+        ev.events |= EPOLLOUT;
+    ev.data.ptr = handler;
+    epoll_ctl(_epoll, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void EventLoop::remove(int fd)
+{
+    epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int EventLoop::poll(int timeoutMS)
+{
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(_epoll, events, MAX_EVENTS, timeoutMS);
+
+    for(int i = 0; i < count; i++)
+        static_cast<Handler *>(events[i].data.ptr)->onEvent(events[i].events);
+
+    return count < 0 ? 0 : count;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+// Thin wrapper around epoll shared by the pty and the control socket so all
+// command sources are served from the single main loop.
+class EventLoop
+{
+public:
+    class Handler
+    {
+    public:
+        virtual ~Handler() {}
+        virtual void onEvent(uint32_t events) = 0;
+    };
+
+    EventLoop();
+    ~EventLoop();
+
+    void add(int fd, Handler * handler);
+    void watch(int fd, Handler * handler, bool readable, bool writable);
+    void remove(int fd);
+
+    // Waits up to timeoutMS and dispatches every ready descriptor.
+    // Returns the number of events handled.
+    int poll(int timeoutMS);
+
+private:
+    static const int MAX_EVENTS = 16;
+    int _epoll;
+};
@@ -0,0 +1,237 @@
+#include "GCodeCommand.h"
+
+#include <stdlib.h>
+#include <locale.h>
+
+namespace
+{
+
+// Powers of ten that are exact in a float
+const float EXACT_POWERS_OF_TEN[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+const int MAX_EXACT_POWER = 10;
+const uint64_t MAX_EXACT_MANTISSA = 1 << 24;
+
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+bool isLineEnd(char c)
+{
+    return c == 0 || c == '\n' || c == '\r';
+}
+
+bool parseList(const char *& ptr, char letter, float first, GCodeCommand & cmd)
+{
+    if(cmd.listCount == GCODE_MAX_LISTS)
+        return false;
+
+    GCodeList & list = cmd.lists[cmd.listCount++];
+    list.letter = letter;
+    list.values[0] = first;
+    list.length = 1;
+    while(*ptr == ':')
+    {
+        ptr++;
+        if(list.length == GCODE_MAX_LIST_LENGTH || !parseGCodeNumber(ptr, list.values[list.length]))
+            return false;
+        list.length++;
+    }
+
+    return true;
+}
+
+// Commands whose argument is free text instead of words, as in Marlin
+bool takesText(char letter, int code)
+{
+    return letter == 'M' && code == 32;
+}
+
+// Slow path for numbers the fast path cannot round exactly. strtof itself
+// would follow the process locale, so use the C locale explicitly.
+float parseSlow(const char * start, const char ** end)
+{
+    static locale_t cLocale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+    return strtof_l(start, (char **)end, cLocale);
+}
+
+}
+
+bool GCodeCommand::set(char wordLetter, float value)
+{
+    uint32_t bit = bitOf(wordLetter);
+    if(bit == 0)
+        return false;
+
+    present |= bit;
+    values[wordLetter - 'A'] = value;
+    return true;
+}
+
+int GCodeCommand::getList(char wordLetter, float * list) const
+{
+    for(int i = 0; i < listCount; i++)
+    {
+        if(lists[i].letter == wordLetter)
+        {
+            for(int j = 0; j < lists[i].length; j++)
+                list[j] = lists[i].values[j];
+            return lists[i].length;
+        }
+    }
+
+    if(!has(wordLetter))
+        return 0;
+    list[0] = values[wordLetter - 'A'];
+    return 1;
+}
+
+bool parseGCodeNumber(const char *& ptr, float & value)
+{
+    const char * start = ptr;
+    const char * p = ptr;
+
+    bool negative = false;
+    if(*p == '-' || *p == '+')
+        negative = *p++ == '-';
+
+    // Collect the digits as one integer mantissa and a decimal exponent
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool overflow = false;
+
+    for(; isDigit(*p); p++, digits++)
+    {
+        if(mantissa < 1000000000000000000ull)
+            mantissa = mantissa * 10 + (*p - '0');
+        else
+        {
+            exponent++;
+            overflow = true;
+        }
+    }
+
+    if(*p == '.')
+    {
+        for(p++; isDigit(*p); p++, digits++)
+        {
+            if(mantissa < 1000000000000000000ull)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+            else
+                overflow = true;
+        }
+    }
+
+    if(digits == 0)
+        return false;
+
+    // Exponents are not used by G-code senders, leave them to the slow path
+    if(*p == 'e' || *p == 'E')
+        overflow = true;
+
+    // A mantissa and power of ten that are both exact in a float give a
+    // correctly rounded result with a single multiply or divide
+    if(!overflow && mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER)
+    {
+        float result = (float)mantissa;
+        if(exponent < 0)
+            result /= EXACT_POWERS_OF_TEN[-exponent];
+        else
+            result *= EXACT_POWERS_OF_TEN[exponent];
+
+        value = negative ? -result : result;
+        ptr = p;
+        return true;
+    }
+
+    const char * end;
+    value = parseSlow(start, &end);
+    ptr = end;
+    return true;
+}
+
+bool parseGCodeLine(const char * line, GCodeCommand & cmd)
+{
+    cmd.clear();
+    cmd.letter = 0;
+
+    const char * ptr = line;
+    for(;;)
+    {
+        char c = *ptr;
+
+        if(isLineEnd(c) || c == ';')
+            break;
+
+        if(c == ' ' || c == '\t')
+        {
+            ptr++;
+            continue;
+        }
+
+        if(c == '(')
+        {
+            while(!isLineEnd(*ptr) && *ptr != ')')
+                ptr++;
+            if(*ptr == ')')
+                ptr++;
+            continue;
+        }
+
+        if(c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        ptr++;
+
+        // The first word names the command and needs an integer code
+        if(cmd.letter == 0)
+        {
+            if((c != 'G' && c != 'M') || !isDigit(*ptr))
+                return false;
+
+            int code = 0;
+            while(isDigit(*ptr))
+            {
+                code = code * 10 + (*ptr++ - '0');
+                if(code > GCODE_MAX_CODE)
+                    return false;
+            }
+
+            cmd.letter = c;
+            cmd.code = code;
+
+            if(takesText(c, code))
+            {
+                while(*ptr == ' ')
+                    ptr++;
+                cmd.text = ptr;
+
+                // Lines from a job file are not terminated after the newline
+                const char * end = ptr;
+                while(!isLineEnd(*end) && *end != ';')
+                    end++;
+                while(end > ptr && (end[-1] == ' ' || end[-1] == '\t'))
+                    end--;
+                cmd.textLength = end - ptr;
+                break;
+            }
+            continue;
+        }
+
+        // A word without a number (e.g. the P in "M106 P") counts as zero
+        float value = 0;
+        if((isDigit(*ptr) || *ptr == '-' || *ptr == '+' || *ptr == '.') && !parseGCodeNumber(ptr, value))
+            return false;
+
+        if(!cmd.set(c, value))
+            return false;
+
+        if(*ptr == ':' && !parseList(ptr, c, value, cmd))
+            return false;
+    }
+
+    return cmd.letter != 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+// A word given as a colon-separated list, as in RepRapFirmware ("Z1:4:0.5").
+// Its first value is also stored in values[] like any other word.
+const int GCODE_MAX_LISTS = 2;
+const int GCODE_MAX_LIST_LENGTH = 8;
+
+// Command numbers above this are rejected, well past the command tables
+const int GCODE_MAX_CODE = 9999;
+
+struct GCodeList
+{
+    char letter;
+    int length;
+    float values[GCODE_MAX_LIST_LENGTH];
+};
+
+// A single G or M command with its parameter words. Text lines and binary
+// frames are both decoded into this so they share one dispatch path.
+// Words are stored by letter, so lookups are a bit test and an array index.
+struct GCodeCommand
+{
+    char letter;        // 'G' or 'M'
+    int code;
+    uint32_t present;   // bit (L - 'A') set when word L was given
+    float values[26];
+    const char * text;  // free-text argument (e.g. the path of M32), only valid
+                        // while the received line is, NULL for other commands
+    int textLength;     // up to the line end or a ';' comment, trailing spaces
+                        // removed; text itself is not NUL-terminated
+    int listCount;
+    GCodeList lists[GCODE_MAX_LISTS];
+
+    void clear() { present = 0; text = 0; textLength = 0; listCount = 0; }
+    bool has(char wordLetter) const { return present & bitOf(wordLetter); }
+    float getFloat(char wordLetter, float value) const { return has(wordLetter) ? values[wordLetter - 'A'] : value; }
+    int getInt(char wordLetter, int value) const { return has(wordLetter) ? (int)values[wordLetter - 'A'] : value; }
+
+    // Copies the values of a list word, or the single value of a plain word.
+    // Returns the number of values, 0 if the word was not given.
+    int getList(char wordLetter, float * list) const;
+
+    // Returns false for anything that is not a letter A-Z
+    bool set(char wordLetter, float value);
+
+    static uint32_t bitOf(char wordLetter)
+    {
+        unsigned index = (unsigned)(wordLetter - 'A');
+        return index < 26 ? 1u << index : 0;
+    }
+};
+
+// Tokenizes a text line such as "G1 Z5 F300" into cmd in a single pass,
+// without allocating. The line ends at a NUL or a newline, spaces between
+// words are optional, letters may be lower case and ';' or '(...)' comments
+// are skipped. Numbers are parsed independently of the locale and rounded
+// exactly. Up to GCODE_MAX_LISTS words may be colon-separated lists.
+// Returns false if the line is not a well-formed G or M command, or its
+// number is above GCODE_MAX_CODE.
+bool parseGCodeLine(const char * line, GCodeCommand & cmd);
+
+// Parses a decimal number at ptr and advances ptr past it.
+// Returns false if ptr does not point at a number.
+bool parseGCodeNumber(const char *& ptr, float & value);
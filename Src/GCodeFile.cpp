@@ -0,0 +1,86 @@
+#include "GCodeFile.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+GCodeFile::GCodeFile()
+    : _data(NULL)
+    , _size(0)
+    , _pos(0)
+    , _lineNumber(0)
+{
+}
+
+GCodeFile::~GCodeFile()
+{
+    close();
+}
+
+bool GCodeFile::open(const char * path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED)
+        return false;
+
+    // Jobs are read front to back exactly once
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    _data = (const char *)data;
+    _size = st.st_size;
+    _pos = 0;
+    _lineNumber = 0;
+    return true;
+}
+
+void GCodeFile::close()
+{
+    if(_data == NULL)
+        return;
+
+    munmap((void *)_data, _size);
+    _data = NULL;
+    _size = 0;
+}
+
+const char * GCodeFile::nextLine(size_t & length)
+{
+    if(_data == NULL || _pos >= _size)
+        return NULL;
+
+    const char * line = _data + _pos;
+    const char * nl = (const char *)memchr(line, '\n', _size - _pos);
+    _lineNumber++;
+
+    if(nl == NULL)
+    {
+        // Nothing after the mapping is guaranteed to be readable, so the
+        // unterminated last line is the one copy
+        _lastLine.assign(line, _size - _pos);
+        _pos = _size;
+        length = _lastLine.size();
+        return _lastLine.c_str();
+    }
+
+    _pos = nl - _data + 1;
+    length = nl - line;
+    if(length > 0 && line[length - 1] == '\r')
+        length--;
+    return line;
+}
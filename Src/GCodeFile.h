@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+// A G-code file mapped into memory and handed out line by line, so jobs can
+// be run through the command parser without a pty in between.
+class GCodeFile
+{
+    const char * _data;
+    size_t _size;
+    size_t _pos;
+    size_t _lineNumber;
+    std::string _lastLine;
+
+public:
+    GCodeFile();
+    ~GCodeFile();
+
+    bool open(const char * path);
+    void close();
+    bool isOpen() const { return _data != NULL; }
+
+    // Returns the next line and its length without the line ending, or NULL
+    // at the end of the file. Lines point into the mapping and end at '\n'
+    // rather than a NUL; only a last line without a newline is copied.
+    const char * nextLine(size_t & length);
+    size_t lineNumber() const { return _lineNumber; }
+};
@@ -0,0 +1,71 @@
+#include "Gpio.h"
+
+#include <wiringPi.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+Gpio::Gpio()
+    : _backend(GPIO_WIRINGPI)
+    , _registers(NULL)
+{
+}
+
+Gpio::~Gpio()
+{
+    close();
+}
+
+bool Gpio::open(Backend backend)
+{
+    close();
+
+    if(backend == GPIO_GPIOMEM)
+    {
+        int fd = ::open("/dev/gpiomem", O_RDWR | O_SYNC | O_CLOEXEC);
+        if(fd < 0)
+            return false;
+
+        void * block = mmap(NULL, BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if(block == MAP_FAILED)
+            return false;
+
+        _registers = (volatile uint32_t *)block;
+    }
+    else if(backend == GPIO_SIMULATED)
+        _registers = (volatile uint32_t *)calloc(BLOCK_SIZE, 1);
+
+    _backend = backend;
+    return true;
+}
+
+void Gpio::close()
+{
+    if(_backend == GPIO_GPIOMEM && _registers != NULL)
+        munmap((void *)_registers, BLOCK_SIZE);
+    else if(_backend == GPIO_SIMULATED)
+        free((void *)_registers);
+
+    _registers = NULL;
+    _backend = GPIO_WIRINGPI;
+}
+
+bool Gpio::read(int pin) const
+{
+    if(_registers == NULL)
+        return digitalRead(pin) == HIGH;
+    return _registers[GPLEV0] & maskOf(pin);
+}
+
+void Gpio::writeWiringPi(uint32_t setMask, uint32_t clearMask)
+{
+    for(int pin = 0; setMask != 0 || clearMask != 0; pin++, setMask >>= 1, clearMask >>= 1)
+    {
+        if(setMask & 1)
+            digitalWrite(pin, HIGH);
+        if(clearMask & 1)
+            digitalWrite(pin, LOW);
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Output pins driven through one of three backends: wiringPi calls, the
+// BCM283x GPIO set/clear registers mapped from /dev/gpiomem, or an in-memory
+// copy of those registers so the motion code runs without a Pi. The register
+// backends change every pin in a mask with a single store.
+class Gpio
+{
+public:
+    enum Backend
+    {
+        GPIO_WIRINGPI,
+        GPIO_GPIOMEM,
+        GPIO_SIMULATED
+    };
+
+    Gpio();
+    ~Gpio();
+
+    // Returns false if /dev/gpiomem cannot be mapped
+    bool open(Backend backend);
+    Backend backend() const { return _backend; }
+
+    static uint32_t maskOf(int pin) { return 1u << pin; }
+
+    // Drives the pins in setMask high, then those in clearMask low
+    void write(uint32_t setMask, uint32_t clearMask)
+    {
+        if(_registers == NULL)
+        {
+            writeWiringPi(setMask, clearMask);
+            return;
+        }
+
+        if(setMask)
+            _registers[GPSET0] = setMask;
+        if(clearMask)
+            _registers[GPCLR0] = clearMask;
+        if(_backend == GPIO_SIMULATED)
+            _registers[GPLEV0] = (_registers[GPLEV0] | setMask) & ~clearMask;
+    }
+
+    bool read(int pin) const;
+
+private:
+    // Word offsets of the registers in the GPIO block
+    static const int GPSET0 = 0x1C / 4;
+    static const int GPCLR0 = 0x28 / 4;
+    static const int GPLEV0 = 0x34 / 4;
+    static const size_t BLOCK_SIZE = 4096;
+
+    void writeWiringPi(uint32_t setMask, uint32_t clearMask);
+    void close();
+
+    Backend _backend;
+    volatile uint32_t * _registers;     // NULL for wiringPi
+};
@@ -1,24 +1,26 @@
 #include "HostPty.h"
+#include "Log.h"
 
-#include <stdio.h>
-#include <string.h>
 #include <unistd.h>
 #include <pty.h>
+#include <stdexcept>
 
 using namespace std;
 
-HostPty::HostPty(const string & pty_name)
+HostPty::HostPty(EventLoop & loop, const string & pty_name, int id)
     : _pty_name(pty_name)
-    , _bufPos(0)
 {
+    int master;
     char name[100] = {0};
-    int res = openpty(&_master, &_slave, name, NULL, NULL);
-    printf("Openpty returned %d\n", res);
-    printf("Name: %s\n", name);
+    int res = openpty(&master, &_slave, name, NULL, NULL);
+    LOG_INFO("Openpty returned %d", res);
+    LOG_INFO("Name: %s", name);
 
     if(res != 0)
         throw std::runtime_error("Cannot open HostPty");
 
+    _channel.reset(new LineChannel(loop, master, id));
+
     unlink(pty_name.c_str());
     res = symlink(name, pty_name.c_str());
     if(res < 0)
@@ -28,40 +30,6 @@ HostPty::HostPty(const string & pty_name)
 HostPty::~HostPty()
 {
     unlink(_pty_name.c_str());
-    close(_master);
+    _channel.reset();
     close(_slave);
 }
-
-bool HostPty::receiveNextString(string & outStr)
-{
-    // Now receive next portion of data
-    struct timeval tv{0, 1000};
-
-    fd_set rfds;
-    FD_ZERO(&rfds);
-    FD_SET(_master, &rfds);
-
-    if (select(_master + 1, &rfds, NULL, NULL, &tv))
-    {
-        // Read symbols one by one until new line is found
-        size_t received_size = read(_master, _buf + _bufPos, 1);
-
-        // Stopping at new line
-        if(_buf[_bufPos] == '\n')
-        {
-            outStr = string(_buf, _bufPos);
-            _bufPos = 0;
-            return true;
-        }
-
-        _bufPos++;
-    }
-
-    return false;
-}
-
-void HostPty::write(const std::string & str)
-{
-    ::write(_master, str.c_str(), str.size());
-    ::write(_master, "\r\n", 2);
-}
@@ -1,22 +1,19 @@
 #pragma once
 
+#include "LineChannel.h"
+
 #include <string>
 #include <memory>
 
 class HostPty
 {
-    int _master;
     int _slave;
     std::string _pty_name;
-
-    static const int BUF_SIZE = 4096;
-    char _buf[BUF_SIZE];
-    size_t _bufPos;
+    std::unique_ptr<LineChannel> _channel;
 
 public:
-    HostPty(const std::string & pty_name);
+    HostPty(EventLoop & loop, const std::string & pty_name, int id);
     ~HostPty();
 
-    bool receiveNextString(std::string & outStr);
-    void write(const std::string & str);
+    LineChannel & channel() { return *_channel; }
 };
@@ -0,0 +1,325 @@
+#include "LineChannel.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+LineChannel::LineChannel(EventLoop & loop, int fd, int id)
+    : _loop(loop)
+    , _fd(fd)
+    , _id(id)
+    , _closed(false)
+    , _head(0)
+    , _scan(0)
+    , _tail(0)
+    , _discarding(false)
+    , _watchingIn(true)
+    , _frameSize(0)
+    , _frameSync(0)
+    , _outPos(0)
+    , _watchingOut(false)
+{
+    // Reads and writes must never block the main loop
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) | O_NONBLOCK);
+    _loop.add(_fd, this);
+}
+
+LineChannel::~LineChannel()
+{
+    close();
+}
+
+void LineChannel::close()
+{
+    if(_fd < 0)
+        return;
+
+    _loop.remove(_fd);
+    ::close(_fd);
+    _fd = -1;
+    _closed = true;
+}
+
+void LineChannel::onEvent(uint32_t events)
+{
+    if(events & EPOLLOUT)
+        flush();
+
+    if(events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        receive();
+}
+
+void LineChannel::compact()
+{
+    // Everything before _head was handed out already; move the unfinished
+    // line to the front so the next read has the whole buffer to fill.
+    if(_head == 0)
+        return;
+
+    memmove(_buf, _buf + _head, _tail - _head);
+    _tail -= _head;
+    _scan -= _head;
+    _head = 0;
+}
+
+void LineChannel::receive()
+{
+    compact();
+
+    for(;;)
+    {
+        if(_tail == BUF_SIZE)
+        {
+            // Complete lines still waiting to be consumed, leave the rest
+            // in the kernel until they are. The level-triggered EPOLLIN would
+            // otherwise wake the loop on every poll.
+            if(hasPendingInput())
+            {
+                watchReadable(false);
+                break;
+            }
+
+            // A single line filled the whole buffer, drop it up to its newline
+            LOG_WARN("Line exceeds %d bytes, discarding", BUF_SIZE);
+            _head = _scan = _tail = 0;
+            _discarding = !isFrameMode();
+        }
+
+        size_t space = BUF_SIZE - _tail;
+        ssize_t received_size = read(_fd, _buf + _tail, space);
+        if(received_size == 0 || (received_size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            close();
+            break;
+        }
+        if(received_size < 0)
+            break;
+
+        _tail += received_size;
+
+        // A short read means the descriptor has been drained
+        if((size_t)received_size < space)
+            break;
+    }
+}
+
+bool LineChannel::hasPendingInput() const
+{
+    if(isFrameMode())
+        return _tail - _head >= _frameSize;
+    return memchr(_buf + _scan, '\n', _tail - _scan) != NULL;
+}
+
+int LineChannel::promote(InputFilter wanted)
+{
+    size_t start = _head;
+    size_t end;
+    int overtaken = 0;
+
+    // The tail of a discarded line is not handed out, so nothing moves ahead of it
+    if(_discarding && !isFrameMode())
+    {
+        const char * nl = (const char *)memchr(_buf + start, '\n', _tail - start);
+        if(nl == NULL)
+            return -1;
+        start = nl - _buf + 1;
+    }
+
+    for(size_t pos = start;; pos = end)
+    {
+        if(isFrameMode())
+        {
+            while(pos < _tail && (uint8_t)_buf[pos] != _frameSync)
+                pos++;
+            if(_tail - pos < _frameSize)
+                return -1;
+            end = pos + _frameSize;
+        }
+        else
+        {
+            const char * nl = (const char *)memchr(_buf + pos, '\n', _tail - pos);
+            if(nl == NULL)
+                return -1;
+            end = nl - _buf + 1;
+        }
+
+        if(wanted(_buf + pos, end - pos))
+        {
+            std::rotate(_buf + start, _buf + pos, _buf + end);
+            _scan = _head;
+            return overtaken;
+        }
+
+        overtaken++;
+    }
+}
+
+void LineChannel::setFrameMode(size_t frameSize, uint8_t sync)
+{
+    _frameSize = frameSize;
+    _frameSync = sync;
+    _discarding = false;
+}
+
+void LineChannel::setLineMode()
+{
+    _frameSize = 0;
+    _scan = _head;
+}
+
+bool LineChannel::nextFrame(void * out)
+{
+    while(_head < _tail && (uint8_t)_buf[_head] != _frameSync)
+        _head++;
+    _scan = _head;
+
+    if(_tail - _head < _frameSize)
+        return false;
+
+    memcpy(out, _buf + _head, _frameSize);
+    _head += _frameSize;
+    _scan = _head;
+    watchReadable(true);
+    return true;
+}
+
+const char * LineChannel::nextLine()
+{
+    for(;;)
+    {
+        char * nl = (char *)memchr(_buf + _scan, '\n', _tail - _scan);
+        if(nl == NULL)
+        {
+            _scan = _tail;
+            return NULL;
+        }
+
+        char * line = _buf + _head;
+        _head = _scan = nl - _buf + 1;
+        watchReadable(true);
+
+        // Tail of a line that was too long to buffer
+        if(_discarding)
+        {
+            _discarding = false;
+            continue;
+        }
+
+        // Frame the line in place
+        *nl = 0;
+        if(nl > line && nl[-1] == '\r')
+            nl[-1] = 0;
+
+        return line;
+    }
+}
+
+void LineChannel::watchReadable(bool enable)
+{
+    if(enable == _watchingIn || _fd < 0)
+        return;
+
+    _loop.watch(_fd, this, enable, _watchingOut);
+    _watchingIn = enable;
+}
+
+void LineChannel::watchWritable(bool enable)
+{
+    if(enable == _watchingOut || _fd < 0)
+        return;
+
+    _loop.watch(_fd, this, _watchingIn, enable);
+    _watchingOut = enable;
+}
+
+void LineChannel::flush()
+{
+    while(_fd >= 0 && _outPos < _out.size())
+    {
+        ssize_t sent = ::write(_fd, _out.data() + _outPos, _out.size() - _outPos);
+        if(sent < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+                _outPos = _out.size();
+            break;
+        }
+        _outPos += sent;
+    }
+
+    if(_outPos == _out.size())
+    {
+        _out.clear();
+        _outPos = 0;
+    }
+
+    watchWritable(hasPendingOutput());
+}
+
+void LineChannel::write(const std::string & str)
+{
+    send(str.data(), str.size(), "\r\n", 2);
+}
+
+void LineChannel::writeFrame(const void * frame, size_t size)
+{
+    send(frame, size, NULL, 0);
+}
+
+void LineChannel::send(const void * data, size_t size, const char * suffix, size_t suffixSize)
+{
+    if(_fd < 0)
+        return;
+
+    // Keep responses in order behind anything that is still pending
+    if(hasPendingOutput())
+    {
+        if(_out.size() - _outPos + size + suffixSize > MAX_PENDING)
+        {
+            LOG_WARN("Channel %d output full, dropping response", _id);
+            return;
+        }
+
+        _out.append((const char *)data, size);
+        _out.append(suffix, suffixSize);
+        flush();
+        return;
+    }
+
+    // Payload and line ending go out in one syscall
+    struct iovec iov[2];
+    iov[0].iov_base = (void *)data;
+    iov[0].iov_len = size;
+    iov[1].iov_base = (void *)suffix;
+    iov[1].iov_len = suffixSize;
+
+    ssize_t sent = writev(_fd, iov, suffixSize ? 2 : 1);
+    if(sent < 0)
+    {
+        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            return;
+        sent = 0;
+    }
+
+    // Hold back whatever the descriptor did not accept
+    if((size_t)sent < size + suffixSize)
+    {
+        if((size_t)sent < size)
+        {
+            _out.assign((const char *)data + sent, size - sent);
+            _out.append(suffix, suffixSize);
+        }
+        else
+            _out.assign(suffix + (sent - size), suffixSize - (sent - size));
+
+        watchWritable(true);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "EventLoop.h"
+
+#include <string>
+
+// A non-blocking, line-oriented command stream over a single descriptor.
+// Each pty or socket client gets its own channel, and with it its own line
+// framing and its own ordered response queue. A channel can also be switched
+// to fixed-size binary frames.
+class LineChannel : public EventLoop::Handler
+{
+    EventLoop & _loop;
+    int _fd;
+    int _id;
+    bool _closed;
+
+    // Incoming bytes are kept between _head and _tail. Complete lines are
+    // terminated in place and handed out as pointers into _buf, so only the
+    // unfinished tail ever has to be moved back to the front of the buffer.
+    static const int BUF_SIZE = 4096;
+    char _buf[BUF_SIZE];
+    size_t _head;
+    size_t _scan;
+    size_t _tail;
+    bool _discarding;
+    bool _watchingIn;   // false while a full buffer waits for its lines to be consumed
+
+    // Non-zero while the channel carries binary frames instead of lines
+    size_t _frameSize;
+    uint8_t _frameSync;
+
+    // Responses the descriptor could not take yet, sent before anything newer.
+    // Capped so a peer that stops reading cannot grow it without bound.
+    static const size_t MAX_PENDING = 64 * 1024;
+    std::string _out;
+    size_t _outPos;
+    bool _watchingOut;
+
+    void compact();
+    void receive();
+    void flush();
+    void watchReadable(bool enable);
+    void watchWritable(bool enable);
+    void close();
+    void send(const void * data, size_t size, const char * suffix, size_t suffixSize);
+
+public:
+    // Takes ownership of fd and registers it with loop
+    LineChannel(EventLoop & loop, int fd, int id);
+    ~LineChannel();
+
+    void onEvent(uint32_t events);
+
+    // Returns the next complete line (without "\r\n") or NULL. The pointer
+    // stays valid until the event loop is polled again.
+    const char * nextLine();
+
+    // Switches framing at the current read position. Bytes before a frame that
+    // do not match sync are skipped, so a reader resyncs after garbage.
+    void setFrameMode(size_t frameSize, uint8_t sync);
+    void setLineMode();
+    bool isFrameMode() const { return _frameSize != 0; }
+
+    // Copies the next complete frame to out, returns false if there is none
+    bool nextFrame(void * out);
+
+    // True if a complete line or frame is waiting to be consumed
+    bool hasPendingInput() const;
+
+    // Moves the first complete line or frame that wanted() accepts in front
+    // of the ones buffered before it, so it is the next one handed out. The
+    // line passed to wanted() ends at its newline. Returns how many lines or
+    // frames it overtook, -1 if none was accepted.
+    typedef bool (*InputFilter)(const char * data, size_t size);
+    int promote(InputFilter wanted);
+
+    // Queues str followed by "\r\n" and sends as much as the descriptor
+    // accepts without blocking. The rest goes out as it becomes writable.
+    void write(const std::string & str);
+    void writeFrame(const void * frame, size_t size);
+    bool hasPendingOutput() const { return _outPos < _out.size(); }
+
+    int id() const { return _id; }
+    bool isClosed() const { return _closed; }
+};
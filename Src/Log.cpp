@@ -0,0 +1,174 @@
+#include "Log.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+namespace
+{
+
+// Bounded multi-producer queue after Dmitry Vyukov: each slot carries a
+// sequence number telling producers and the consumer whose turn it is.
+class LogRing
+{
+public:
+    static const size_t SLOTS = 256;            // must be a power of two
+    static const size_t MESSAGE_LEN = 120;
+
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        LogLevel level;
+        char text[MESSAGE_LEN];
+    };
+
+    LogRing()
+        : _enqueuePos(0)
+        , _dequeuePos(0)
+        , _dropped(0)
+    {
+        for(size_t i = 0; i < SLOTS; i++)
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // Returns a slot to fill and publish(), or NULL if the ring is full
+    Slot * claim()
+    {
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Slot & slot = _slots[pos & (SLOTS - 1)];
+            intptr_t diff = (intptr_t)slot.seq.load(std::memory_order_acquire) - (intptr_t)pos;
+            if(diff == 0)
+            {
+                if(_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    return &slot;
+            }
+            else if(diff < 0)
+            {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return NULL;
+            }
+            else
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    void publish(Slot * slot, size_t pos)
+    {
+        slot->seq.store(pos + 1, std::memory_order_release);
+    }
+
+    size_t positionOf(Slot * slot) const
+    {
+        return slot->seq.load(std::memory_order_relaxed);
+    }
+
+    // Single consumer: the drain thread
+    Slot * peek()
+    {
+        size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        Slot & slot = _slots[pos & (SLOTS - 1)];
+        if(slot.seq.load(std::memory_order_acquire) != pos + 1)
+            return NULL;
+        return &slot;
+    }
+
+    void release(Slot * slot)
+    {
+        size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        slot->seq.store(pos + SLOTS, std::memory_order_release);
+        _dequeuePos.store(pos + 1, std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return _dequeuePos.load(std::memory_order_acquire) == _enqueuePos.load(std::memory_order_acquire);
+    }
+
+    size_t takeDropped()
+    {
+        return _dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    Slot _slots[SLOTS];
+    std::atomic<size_t> _enqueuePos;
+    std::atomic<size_t> _dequeuePos;
+    std::atomic<size_t> _dropped;
+};
+
+LogRing & logRing()
+{
+    static LogRing ring;
+    return ring;
+}
+
+const char LEVEL_TAGS[] = { 'D', 'I', 'W', 'E' };
+
+void drainLog()
+{
+    LogRing & ring = logRing();
+    char batch[4096];
+
+    for(;;)
+    {
+        size_t used = 0;
+        LogRing::Slot * slot;
+        while((slot = ring.peek()) != NULL && used + LogRing::MESSAGE_LEN + 8 < sizeof(batch))
+        {
+            used += snprintf(batch + used, sizeof(batch) - used, "[%c] %s\n", LEVEL_TAGS[slot->level], slot->text);
+            ring.release(slot);
+        }
+
+        size_t dropped = ring.takeDropped();
+        if(dropped != 0)
+            used += snprintf(batch + used, sizeof(batch) - used, "[W] %zu log messages dropped\n", dropped);
+
+        if(used == 0)
+        {
+            usleep(10000);
+            continue;
+        }
+
+        ssize_t written = write(STDOUT_FILENO, batch, used);
+        (void)written;
+    }
+}
+
+}
+
+void startLogging()
+{
+    std::thread(drainLog).detach();
+}
+
+void flushLogging()
+{
+    // The drain thread writes a batch right after releasing its slots
+    for(int i = 0; i < 100 && !logRing().empty(); i++)
+        usleep(10000);
+    usleep(10000);
+}
+
+void logMessage(LogLevel level, const char * format, ...)
+{
+    LogRing & ring = logRing();
+    LogRing::Slot * slot = ring.claim();
+    if(slot == NULL)
+        return;
+
+    // The slot still holds the claimed position until it is published
+    size_t pos = ring.positionOf(slot);
+
+    slot->level = level;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(slot->text, LogRing::MESSAGE_LEN, format, args);
+    va_end(args);
+
+    ring.publish(slot, pos);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Config.h"
+
+// Asynchronous logging. Messages are formatted into a lock-free ring buffer
+// and written to stdout by a background thread, so the main loop never waits
+// on the terminal or journald. Messages below LOG_LEVEL, or all of them when
+// ENABLE_LOGGING is 0, are compiled out together with their arguments.
+
+enum LogLevel
+{
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO = 1,
+    LOG_LEVEL_WARN = 2,
+    LOG_LEVEL_ERROR = 3
+};
+
+// Starts the thread that drains the ring buffer. Messages logged before this
+// are kept and written once it runs.
+void startLogging();
+
+// Waits (up to a second) until everything logged so far has been written,
+// for use before the process exits.
+void flushLogging();
+
+// Never blocks. If the ring buffer is full the message is dropped and counted.
+void logMessage(LogLevel level, const char * format, ...) __attribute__((format(printf, 2, 3)));
+
+#if ENABLE_LOGGING
+#define LOG_AT(level, ...) do { if((level) >= LOG_LEVEL) logMessage((level), __VA_ARGS__); } while(0)
+#else
+#define LOG_AT(level, ...) do { } while(0)
+#endif
+
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
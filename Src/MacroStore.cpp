@@ -0,0 +1,37 @@
+#include "MacroStore.h"
+
+MacroStore::MacroStore(CommandHandler replayHandler)
+    : _replayHandler(replayHandler)
+    , _recording(NULL)
+{
+    for(int i = 0; i < MACRO_COUNT; i++)
+        _macros[i].count = 0;
+}
+
+const Macro * MacroStore::find(int id) const
+{
+    if(id < 0 || id >= MACRO_COUNT)
+        return NULL;
+    return &_macros[id];
+}
+
+bool MacroStore::start(int id)
+{
+    if(id < 0 || id >= MACRO_COUNT)
+        return false;
+
+    _recording = &_macros[id];
+    _recording->count = 0;
+    return true;
+}
+
+bool MacroStore::record(const GCodeCommand & cmd, const CommandEntry * entry)
+{
+    if(entry->handler == _replayHandler || _recording->count == MACRO_LENGTH)
+        return false;
+
+    _recording->cmds[_recording->count] = cmd;
+    _recording->entries[_recording->count] = entry;
+    _recording->count++;
+    return true;
+}
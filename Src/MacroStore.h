@@ -0,0 +1,42 @@
+#pragma once
+
+#include "CommandTable.h"
+#include "Config.h"
+
+// Recorded command sequences. NanoDLP can record its per-layer peel sequence
+// once and then run it with a single M802. Each command is stored with its
+// table entry, so only supported commands are recorded and a replay runs
+// exactly what was accepted. The shield and PrintTime record through the
+// same store, so both accept and refuse the same macro commands.
+struct Macro
+{
+    GCodeCommand cmds[MACRO_LENGTH];
+    const CommandEntry * entries[MACRO_LENGTH];
+    int count;
+};
+
+class MacroStore
+{
+public:
+    // Commands run by replayHandler are refused, macros do not nest
+    MacroStore(CommandHandler replayHandler);
+
+    // NULL if id is not a macro number
+    const Macro * find(int id) const;
+
+    // Empties macro id and records into it until stop(), false if id is not a
+    // macro number
+    bool start(int id);
+    void stop() { _recording = NULL; }
+
+    // Immediate commands still run while a macro is recorded
+    bool records(const CommandEntry * entry) const { return _recording != NULL && !entry->immediate; }
+
+    // False, and nothing is recorded, for a replay and once the macro is full
+    bool record(const GCodeCommand & cmd, const CommandEntry * entry);
+
+private:
+    CommandHandler _replayHandler;
+    Macro _macros[MACRO_COUNT];
+    Macro * _recording;
+};
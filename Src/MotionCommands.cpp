@@ -0,0 +1,106 @@
+#include "MotionCommands.h"
+#include "Config.h"
+
+#include <math.h>
+#include <algorithm>
+
+static_assert(AUX_AXIS_COUNT < STEP_EVENT_AXES, "More auxiliary axes than step event bits");
+
+namespace
+{
+
+float stepsPerUnit(int axis) // Z in steps/mm, the auxiliary axes in steps of their own unit
+{
+    return axis == 0 ? STEPS_PER_MM : AUX_STEPS_PER_UNIT[axis - 1];
+}
+
+}
+
+MotionCommands::MotionCommands(const MotionPlanner & planner, MoveHandler plan)
+    : _planner(planner)
+    , _plan(plan)
+    , _relative(true)
+    , _speed(DEFAULT_SPEED)
+    , _defaultJerk(DEFAULT_JERK)
+{
+}
+
+void MotionCommands::move(const GCodeCommand & cmd)
+{
+    if(cmd.getFloat('F', 0) != 0)
+        _speed = cmd.getFloat('F', 0) / 60;
+
+    PlannedMove move;
+    for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        move.targets[axis] = _relative ? _planner.getEndPositionInSteps(axis) : 0;
+
+    move.targets[0] += lround(cmd.getFloat('Z', 0) * STEPS_PER_MM);
+    for(int axis = 1; axis <= AUX_AXIS_COUNT; axis++)
+    {
+        char letter = AUX_AXIS_LETTERS[axis - 1];
+        if(cmd.has(letter))
+            move.targets[axis] += lround(cmd.getFloat(letter, 0) * stepsPerUnit(axis));
+        else if(!_relative)
+            move.targets[axis] = _planner.getEndPositionInSteps(axis);
+    }
+
+    plan(move, cmd.getFloat('J', _defaultJerk), true);
+}
+
+bool MotionCommands::peel(const GCodeCommand & cmd)
+{
+    float distances[GCODE_MAX_LIST_LENGTH];
+    float speeds[GCODE_MAX_LIST_LENGTH];
+    int count = cmd.getList('Z', distances);
+    int speedCount = cmd.getList('F', speeds);
+    if(count == 0 || speedCount > count)
+        return false;
+
+    // The segments blend like consecutive G1 moves, a speed applies until the
+    // next one given
+    long target = _planner.getEndPositionInSteps();
+    for(int i = 0; i < count; i++)
+    {
+        if(i < speedCount && speeds[i] != 0)
+            _speed = speeds[i] / 60;
+        target += lround(distances[i] * STEPS_PER_MM);
+
+        PlannedMove move;
+        for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+            move.targets[axis] = _planner.getEndPositionInSteps(axis);
+        move.targets[0] = target;
+        if(!plan(move, 0, i == count - 1))
+            break;
+    }
+    return true;
+}
+
+bool MotionCommands::plan(PlannedMove & move, float jerk, bool last)
+{
+    // With auxiliary axes the speeds are those of the axis travelling
+    // farthest in its own units, handed to the planner in steps of the axis
+    // with the most steps
+    move.scale = STEPS_PER_MM;
+    long leadSteps = 0;
+    float travel = 0;
+    for(int axis = 1; axis <= AUX_AXIS_COUNT; axis++)
+    {
+        if(move.targets[axis] == _planner.getEndPositionInSteps(axis))
+            continue;
+
+        for(int i = 0; i <= AUX_AXIS_COUNT; i++)
+        {
+            long steps = labs(move.targets[i] - _planner.getEndPositionInSteps(i));
+            leadSteps = std::max(leadSteps, steps);
+            travel = std::max(travel, steps / stepsPerUnit(i));
+        }
+        move.scale = leadSteps / travel;
+        break;
+    }
+
+    move.speed = _speed * move.scale;
+    move.acceleration = DEFAULT_ACCELERATION * move.scale;
+    move.jerk = jerk * move.scale;
+    move.last = last;
+    return _plan(move);
+}
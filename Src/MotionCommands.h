@@ -0,0 +1,50 @@
+#pragma once
+
+#include "MotionPlanner.h"
+#include "GCodeCommand.h"
+#include "StepBuffer.h"
+
+// Turns G1 and M810 into planner moves, along with the state they depend on:
+// relative or absolute positioning, the speed of the last F word and the
+// default jerk. The shield and PrintTime both plan through it, so a job is
+// timed with the targets and speeds it runs with.
+
+struct PlannedMove
+{
+    long targets[STEP_EVENT_AXES];
+    float speed;            // steps/s of the axis with the most steps
+    float acceleration;     // steps/s^2
+    float jerk;             // steps/s^3, 0 for trapezoidal moves
+    float scale;            // steps per mm, or per unit of the auxiliary axis travelling farthest
+    bool last;              // last move of its command, the one reported as complete
+};
+
+// Hands a move to the planner. Returning false drops it and the rest of its
+// command.
+typedef bool (*MoveHandler)(const PlannedMove & move);
+
+class MotionCommands
+{
+public:
+    MotionCommands(const MotionPlanner & planner, MoveHandler plan);
+
+    void setRelative(bool relative) { _relative = relative; }
+    void setDefaultJerk(float jerk) { _defaultJerk = jerk; }    // mm/s^3, 0 for trapezoidal moves
+
+    // G1 Znnn Annn Bnnn Fnnn Jnnn. The auxiliary axes only move if their word
+    // is given.
+    void move(const GCodeCommand & cmd);
+
+    // M810 Zd1:d2:... Ff1:f2:... - relative Z segments, each at its own speed.
+    // False, and nothing is planned, if the lists are invalid.
+    bool peel(const GCodeCommand & cmd);
+
+private:
+    bool plan(PlannedMove & move, float jerk, bool last);
+
+    const MotionPlanner & _planner;
+    MoveHandler _plan;
+    bool _relative;
+    float _speed;           // mm/s, set by the last F word
+    float _defaultJerk;     // mm/s^3
+};
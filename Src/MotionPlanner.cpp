@@ -0,0 +1,159 @@
+#include "MotionPlanner.h"
+
+#include <math.h>
+#include <algorithm>
+
+MotionPlanner::MotionPlanner(SpeedyStepper & stepper)
+    : _stepper(stepper)
+    , _frontStarted(false)
+    , _maxSpeed(0)
+    , _clampedMoves(0)
+{
+    for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        _endPositions[axis] = 0;
+}
+
+bool MotionPlanner::addMove(long target, float speed, float acceleration, float jerk)
+{
+    long targets[STEP_EVENT_AXES];
+    for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        targets[axis] = _endPositions[axis];
+    targets[0] = target;
+    return addMove(targets, speed, acceleration, jerk);
+}
+
+bool MotionPlanner::addMove(const long * targets, float speed, float acceleration, float jerk)
+{
+    Move * move = _moves.push();
+    if(move == NULL)
+        return false;
+
+    if(_maxSpeed > 0 && speed > _maxSpeed)
+    {
+        speed = _maxSpeed;
+        _clampedMoves++;
+    }
+
+    long target = targets[0];
+    long leadDistance = 0;
+    move->coordinated = false;
+    for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+    {
+        move->distances[axis] = targets[axis] - _endPositions[axis];
+        leadDistance = std::max(leadDistance, labs(move->distances[axis]));
+        if(axis > 0 && move->distances[axis] != 0)
+            move->coordinated = true;
+    }
+
+    move->target = target;
+    move->distance = labs(move->distances[0]);
+    move->direction = move->distances[0] > 0 ? 1 : (move->distances[0] < 0 ? -1 : 0);
+    if(move->coordinated)
+    {
+        move->distance = leadDistance;
+        move->direction = 0;
+    }
+    move->speed = speed;
+    move->acceleration = acceleration;
+    move->jerk = jerk;
+    move->junctionSpeed = 0;
+    move->entrySpeed = 0;
+    move->exitSpeed = 0;
+    for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        _endPositions[axis] = targets[axis];
+
+    // Trapezoidal moves in the same direction run through the junction at the
+    // lower of their two speeds
+    if(_moves.size() > 1)
+    {
+        Move & previous = _moves[_moves.size() - 2];
+        if(previous.direction != 0 && previous.direction == move->direction && previous.jerk == 0 && jerk == 0)
+            previous.junctionSpeed = std::min(previous.speed, move->speed);
+    }
+
+    plan();
+    return true;
+}
+
+void MotionPlanner::plan()
+{
+    // Backward pass: each move must be able to slow down to what the next one
+    // can enter with, the last one to rest
+    float nextEntry = 0;
+    for(size_t i = _moves.size(); i-- > 0;)
+    {
+        Move & move = _moves[i];
+        move.exitSpeed = std::min(move.junctionSpeed, nextEntry);
+        nextEntry = std::min(move.speed, sqrtf(move.exitSpeed * move.exitSpeed + 2 * move.acceleration * move.distance));
+    }
+
+    // Forward pass: no move can exit faster than it can accelerate to. The move
+    // being rendered can only run faster into the next one while it has not
+    // started to decelerate.
+    for(size_t i = 0; i < _moves.size(); i++)
+    {
+        Move & move = _moves[i];
+        if(i > 0)
+            move.entrySpeed = _moves[i - 1].exitSpeed;
+
+        float reachable = sqrtf(move.entrySpeed * move.entrySpeed + 2 * move.acceleration * move.distance);
+        if(move.exitSpeed > reachable)
+            move.exitSpeed = reachable;
+
+        if(i == 0 && _frontStarted)
+        {
+            float planned = move.exitSpeed;
+            move.exitSpeed = _stepper.getExitSpeedInStepsPerSecond();
+            if(planned > move.exitSpeed && _stepper.setExitSpeedInStepsPerSecond(planned))
+                move.exitSpeed = planned;
+        }
+    }
+}
+
+void MotionPlanner::render(StepBuffer & buffer, unsigned long renderAhead_InUS)
+{
+    while(!_moves.empty())
+    {
+        Move & move = _moves.front();
+        if(!_frontStarted)
+        {
+            _stepper.setSpeedInStepsPerSecond(move.speed);
+            _stepper.setAccelerationInStepsPerSecondPerSecond(move.acceleration);
+            _stepper.setJerkInStepsPerSecondPerSecondPerSecond(move.jerk);
+            if(move.coordinated)
+            {
+                // The stepper renders the lead axis from 0, Z is set once it is done
+                _axes.setup(move.distances);
+                _stepper.setCurrentPositionInSteps(0);
+                _stepper.setupMoveInSteps(move.distance, move.entrySpeed, move.exitSpeed);
+            }
+            else
+                _stepper.setupMoveInSteps(move.target, move.entrySpeed, move.exitSpeed);
+            _frontStarted = true;
+        }
+
+        if(!_stepper.renderMovement(buffer, renderAhead_InUS, move.coordinated ? &_axes : NULL))
+            return;
+
+        if(move.coordinated)
+            _stepper.setCurrentPositionInSteps(move.target);
+
+        _moves.pop();
+        _frontStarted = false;
+    }
+}
+
+double MotionPlanner::takeMoveTimeInSeconds()
+{
+    if(_moves.empty() || _frontStarted)
+        return 0;
+
+    Move & move = _moves.front();
+    _stepper.setSpeedInStepsPerSecond(move.speed);
+    _stepper.setAccelerationInStepsPerSecondPerSecond(move.acceleration);
+    _stepper.setJerkInStepsPerSecondPerSecondPerSecond(move.jerk);
+    double time = _stepper.getMoveTimeInSeconds(move.distance, move.entrySpeed, move.exitSpeed);
+
+    _moves.pop();
+    return time;
+}
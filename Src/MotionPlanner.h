@@ -0,0 +1,79 @@
+#pragma once
+
+#include "SpeedyStepper.h"
+#include "StepBuffer.h"
+#include "CommandQueue.h"
+
+#include <stdint.h>
+
+// Holds the moves queued behind the one being rendered and plans the speed at
+// each junction between them, so consecutive moves in one direction run through
+// at speed. Only direction reversals, S-curve moves and the last queued move
+// come to rest. All speeds are in steps/second. Moves of the other axes are
+// coordinated with Z and always come to rest, their speeds are those of the
+// axis with the most steps.
+class MotionPlanner
+{
+public:
+    static const size_t DEPTH = 8;
+
+    MotionPlanner(SpeedyStepper & stepper);
+
+    bool empty() const { return _moves.empty(); }
+    bool full() const { return _moves.full(); }
+
+    // Position at the end of the last queued move, where the next one starts.
+    // Axis 0 is Z.
+    long getEndPositionInSteps(int axis = 0) const { return _endPositions[axis]; }
+
+    // Only while empty, after the motor was moved directly
+    void setPositionInSteps(long position, int axis = 0) { _endPositions[axis] = position; }
+
+    // Drops every queued move, only once the executor no longer plays back
+    // what was rendered. The position must be set again afterwards.
+    void clear() { _moves.clear(); _frontStarted = false; }
+
+    // Speeds above the limit are clamped to it, 0 for no limit
+    void setMaxSpeed(float speed) { _maxSpeed = speed; }
+    float getMaxSpeed() const { return _maxSpeed; }
+    uint32_t getClampedMoves() const { return _clampedMoves; }
+
+    // Returns false, and plans nothing, when the planner is full
+    bool addMove(long target, float speed, float acceleration, float jerk);
+
+    // Moves every axis to its target, Z first
+    bool addMove(const long * targets, float speed, float acceleration, float jerk);
+
+    // Renders queued moves into the buffer until renderAhead_InUS are buffered
+    void render(StepBuffer & buffer, unsigned long renderAhead_InUS);
+
+    // Removes the front move without rendering it and returns how long it
+    // would take at its planned speeds. Only while nothing is being rendered.
+    double takeMoveTimeInSeconds();
+
+private:
+    struct Move
+    {
+        long target;
+        long distance;          // of the lead axis in a coordinated move
+        int direction;          // 0 for coordinated moves, which never blend
+        bool coordinated;
+        long distances[STEP_EVENT_AXES];
+        float speed;
+        float acceleration;
+        float jerk;
+        float junctionSpeed;    // limit at the junction with the next move
+        float entrySpeed;
+        float exitSpeed;
+    };
+
+    void plan();
+
+    SpeedyStepper & _stepper;
+    CommandQueue<Move, DEPTH> _moves;
+    CoordinatedAxes _axes;      // of the front move, if it is coordinated
+    bool _frontStarted;         // front move is set up in the stepper and rendering
+    long _endPositions[STEP_EVENT_AXES];
+    float _maxSpeed;
+    uint32_t _clampedMoves;
+};
@@ -0,0 +1,105 @@
+#include "MotionThread.h"
+#include "StatusPage.h"
+#include "Log.h"
+#include "Config.h"
+
+#include <wiringPi.h>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+namespace
+{
+
+const size_t PREFAULT_STACK_SIZE = 64 * 1024;
+
+// Waits longer than the margin are slept through, waking up early by it to
+// cover the scheduler's wake-up latency, and the rest is spun. Only a thread
+// pinned to a reserved CPU can afford the wide margin: sharing a CPU, the
+// spinning would starve the main thread that refills the step buffer, since
+// at high step rates every step period is shorter than the margin.
+const unsigned long PINNED_SLEEP_MARGIN_US = 100;
+const unsigned long SHARED_SLEEP_MARGIN_US = 20;
+const unsigned long IDLE_SLEEP_US = 200;
+
+// The status page is written between steps, at most this often while moving
+const unsigned long STATUS_INTERVAL_US = 1000;
+
+void prefaultStack()
+{
+    char stack[PREFAULT_STACK_SIZE];
+    volatile char * touch = stack;
+    for(size_t i = 0; i < PREFAULT_STACK_SIZE; i += 256)
+        touch[i] = 0;
+}
+
+void sleepUS(unsigned long us)
+{
+    timespec duration;
+    duration.tv_sec = us / 1000000;
+    duration.tv_nsec = (us % 1000000) * 1000;
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &duration, NULL);
+}
+
+void configureThread()
+{
+    if(MOTION_THREAD_CPU >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(MOTION_THREAD_CPU, &cpus);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if(error != 0)
+            LOG_WARN("Cannot move the motion thread to CPU %d: %s", MOTION_THREAD_CPU, strerror(error));
+    }
+
+    sched_param param;
+    param.sched_priority = MOTION_THREAD_PRIORITY;
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if(error != 0)
+        LOG_WARN("Motion thread runs without real-time priority: %s", strerror(error));
+
+    prefaultStack();
+}
+
+void runMotion(StepExecutor * executor)
+{
+    configureThread();
+
+    const unsigned long sleepMargin_InUS = MOTION_THREAD_CPU >= 0 ? PINNED_SLEEP_MARGIN_US : SHARED_SLEEP_MARGIN_US;
+    unsigned long lastStatus_InUS = micros();
+    for(;;)
+    {
+        if(executor->process())
+        {
+            publishMotionStatus(*executor);
+            usleep(IDLE_SLEEP_US);
+            continue;
+        }
+
+        if(micros() - lastStatus_InUS >= STATUS_INTERVAL_US)
+        {
+            publishMotionStatus(*executor);
+            lastStatus_InUS = micros();
+        }
+
+        unsigned long waitUS = executor->getWaitInUS();
+        if(waitUS > sleepMargin_InUS)
+            sleepUS(waitUS - sleepMargin_InUS);
+    }
+}
+
+}
+
+void startMotionThread(StepExecutor & executor)
+{
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        LOG_WARN("Cannot lock memory: %s", strerror(errno));
+
+    std::thread(runMotion, &executor).detach();
+}
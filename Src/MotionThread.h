@@ -0,0 +1,11 @@
+#pragma once
+
+#include "StepExecutor.h"
+
+// Runs the step executor on its own thread, so parsing, I/O and logging on
+// the main thread cannot delay a step. The thread asks for SCHED_FIFO
+// priority and the CPU set in Config.h, memory is locked and the thread's
+// stack is touched up front so it never waits for a page fault. Without root
+// it still runs, at normal priority, and says so in the log. The thread also
+// keeps the motion block of the status page up to date.
+void startMotionThread(StepExecutor & executor);
@@ -1,12 +1,32 @@
+#include "EventLoop.h"
 #include "HostPty.h"
+#include "ControlSocket.h"
 #include "SpeedyStepper.h"
+#include "StepExecutor.h"
+#include "Gpio.h"
+#include "MotionPlanner.h"
+#include "MotionThread.h"
+#include "StepRateProbe.h"
+#include "Endstops.h"
+#include "StatusPage.h"
+#include "Thermometer.h"
+#include "CommandQueue.h"
+#include "GCodeCommand.h"
+#include "BinaryProtocol.h"
+#include "Commands.h"
+#include "MotionCommands.h"
+#include "MacroStore.h"
+#include "GCodeFile.h"
+#include "Log.h"
 #include "Config.h"
 
 #include <wiringPi.h>
-#include <iostream>
 #include <cstring>
+#include <cmath>
 #include <sstream>
 #include <iomanip>
+#include <signal.h>
+#include <memory>
 
 using namespace std;
 
@@ -15,15 +35,175 @@ using namespace std;
 #endif
 SpeedyStepper stepper;  //Define SpeedyStepper motor as stepper
 
-bool relativePositioning = true;  //Use relative positioning
+// G-code moves are planned so that moves in one direction blend into each
+// other, rendered by the stepper into step intervals a few ms ahead and played
+// back by the executor, which owns the step and direction pins while a move
+// runs. Homing and the buttons still step the motor directly.
+const unsigned long RENDER_AHEAD_US = 5000;
+
+MotionPlanner planner(stepper);
+Gpio gpio;
+Gpio::Backend gpioBackend = (Gpio::Backend)GPIO_BACKEND;
+StepBuffer stepBuffer;
+StepExecutor stepExecutor(stepBuffer, gpio);
+
+// Measured step rates, 0 until probed. Speeds above STEP_RATE_MARGIN of them
+// are clamped, G1 moves by the planner, homing and the buttons here.
+StepRateLimits stepRateLimits = { 0, 0 };
+
 unsigned long lastMovementMS = 0;
+int fanPwm = 0;  //0-1023, as last set by M106 P1 or M107 P1
+
+// NanoDLP talks to us through the pty, local tools through the control
+// socket. Both are served from the same event loop and share one command queue.
+// Neither is opened when a job file is run from the command line.
+const int PTY_CHANNEL = 0;
+
+EventLoop eventLoop;
+unique_ptr<HostPty> pty;
+unique_ptr<ControlSocket> controlSocket;
+
+// Commands read from a job file have no channel, their responses are only logged
+const int FILE_CHANNEL = -2;
+
+GCodeFile jobFile;
+bool jobRunning = false;
+int jobChannel = PTY_CHANNEL;
+unsigned long jobStartMS = 0;
+unsigned long jobElapsedMS = 0;
+size_t jobCommands = 0;
+
+// Channel the command being processed came from, responses go back there.
+// The sequence number is only used by binary mode channels.
+int responseChannel = PTY_CHANNEL;
+uint16_t responseSeq = 0;
+
+// Commands are validated and acknowledged as soon as they arrive, then wait
+// here until the move or dwell ahead of them has finished
+const size_t COMMAND_QUEUE_DEPTH = 32;
+
+struct QueuedCommand
+{
+    GCodeCommand cmd;
+    const CommandEntry * entry;
+    int channel;
+    uint16_t seq;
+};
 
-HostPty pty("/tmp/ttyNanoDLP");
+CommandQueue<QueuedCommand, COMMAND_QUEUE_DEPTH> commandQueue;
+
+enum ExecutionState
+{
+    EXEC_IDLE,
+    EXEC_MOVING,
+    EXEC_DWELLING,
+    EXEC_HOMING
+};
+
+ExecutionState executionState = EXEC_IDLE;
+
+// Where to send Z_move_comp for each move that is planned or running, in order
+struct MoveCompletion
+{
+    int channel;
+    uint16_t seq;
+    bool muted;
+};
+
+CommandQueue<MoveCompletion, 2 * MotionPlanner::DEPTH> moveCompletions;
+MoveCompletion homingCompletion;
+uint32_t reportedMoves = 0;
+uint32_t syncedDroppedSteps = 0;   // steps dropped at an endstop, up to the last resync
+unsigned long dwellStartMS = 0;
+unsigned long dwellDurationMS = 0;
+
+// M25 holds the motor and starts no further command until M24. M112 holds it
+// too, then drops everything planned or queued once it has stopped.
+enum EmergencyStop
+{
+    STOP_NONE,
+    STOP_DECELERATING,
+    STOP_FLUSHING
+};
+
+bool feedHold = false;
+EmergencyStop emergencyStop = STOP_NONE;
+MoveCompletion emergencyStopCompletion;
+
+// A replayed macro is acknowledged by one Z_move_comp when the whole
+// sequence has finished
+MacroStore macros(handleReplayMacro);
+int recordingChannel = -1;      // channel whose commands go into a macro, -1 if none
+const Macro * replayMacro = NULL;
+int replayIndex = 0;
+int replayChannel = PTY_CHANNEL;
+uint16_t replaySeq = 0;
+
+// Set while a macro step runs so its own responses are not sent
+bool muteResponses = false;
+
+// While this loop takes the steps itself, input is only polled this often so
+// stepping stays tight
+const unsigned long IO_POLL_INTERVAL_US = 1000;
+
+float currentPositionInMillimeters() // Position of the motor, not of the rendered steps
+{
+    // Homing steps the motor directly
+    if(executionState == EXEC_HOMING)
+        return stepper.getCurrentPositionInMillimeters();
+    return stepExecutor.getPositionInSteps() / (float)STEPS_PER_MM;
+}
+
+float currentVelocityInMillimetersPerSecond()
+{
+    return stepExecutor.getVelocityInStepsPerSecond() / STEPS_PER_MM;
+}
 
-void ptyWrite(const string & str)  //Write string to virtual console
+void syncExecutorPosition() // After the motor was stepped directly
 {
-    pty.write(str);
-    cout << str << endl;
+    stepExecutor.setPositionInSteps(stepper.getCurrentPositionInSteps());
+    planner.setPositionInSteps(stepper.getCurrentPositionInSteps());
+}
+
+void syncPlannerPosition() // After steps were dropped, plan on from where the motors stopped
+{
+    stepper.setCurrentPositionInSteps(stepExecutor.getPositionInSteps());
+    for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        planner.setPositionInSteps(stepExecutor.getPositionInSteps(axis), axis);
+}
+
+float directSpeedInMillimetersPerSecond(float speed) // Clamped to what processMovement can step
+{
+    float limit = stepRateLimits.directStepsPerSecond * STEP_RATE_MARGIN / STEPS_PER_MM;
+    return (limit > 0 && speed > limit) ? limit : speed;
+}
+
+LineChannel * findChannel(int id)
+{
+    if(id == PTY_CHANNEL)
+        return pty ? &pty->channel() : NULL;
+    return controlSocket ? controlSocket->find(id) : NULL;
+}
+
+void respond(const string & str, BinaryStatus status)  //Write a response to the channel the current command came from
+{
+    LineChannel * channel = muteResponses ? NULL : findChannel(responseChannel);
+    if(channel != NULL)
+    {
+        if(channel->isFrameMode())
+        {
+            BinaryResponse response;
+            response.sync = BINARY_SYNC;
+            response.status = status;
+            response.seq = responseSeq;
+            response.positionInMillimeters = currentPositionInMillimeters();
+            response.velocityInMillimetersPerSecond = currentVelocityInMillimetersPerSecond();
+            channel->writeFrame(&response, sizeof(response));
+        }
+        else
+            channel->write(str);
+    }
+    LOG_DEBUG("%s", str.c_str());
 }
 
 #if defined(HAS_2130)
@@ -37,18 +217,20 @@ void ptyWrite(const string & str)  //Write string to virtual console
 #if SUPPORT_UP_DOWN_BUTTONS
 void setSteperLowSpeed()
 {
-    stepper.setSpeedInMillimetersPerSecond(LOW_SPEED);
+    stepper.setSpeedInMillimetersPerSecond(directSpeedInMillimetersPerSecond(LOW_SPEED));
     stepper.setAccelerationInMillimetersPerSecondPerSecond(LOW_ACCELERATION);
 }
 
 void setSteperHighSpeed()
 {
-    stepper.setSpeedInMillimetersPerSecond(HIGH_SPEED);
+    stepper.setSpeedInMillimetersPerSecond(directSpeedInMillimetersPerSecond(HIGH_SPEED));
     stepper.setAccelerationInMillimetersPerSecondPerSecond(HIGH_ACCELERATION);
 }
 
 void processBtnMovement(int btnPin, int direction = 1)
 {
+    stepper.setJerkInMillimetersPerSecondPerSecondPerSecond(0);
+
     // Try small movements first
     setSteperHighSpeed();
     for(int i=0; i<5; i++)
@@ -115,12 +297,25 @@ bool shouldDisableMotors() //If over 100S since last movement, motor is disabled
 void processMotorOnCmd() //M17 enable motor driver
 {
     updateLastMovement();
-    digitalWrite(ENABLE_PIN, LOW);
+    gpio.write(0, Gpio::maskOf(ENABLE_PIN));
 }
 
 void processMotorOffCmd() //M18 disable motor driver
 {
-    digitalWrite(ENABLE_PIN, HIGH);
+    gpio.write(Gpio::maskOf(ENABLE_PIN), 0);
+}
+
+void probeStepRate() // Measure the step rates with the driver disabled, then restore it
+{
+    bool enabled = !gpio.read(ENABLE_PIN);
+    processMotorOffCmd();
+    stepRateLimits = probeStepRates(gpio);
+    if(enabled)
+        processMotorOnCmd();
+
+    planner.setMaxSpeed(stepRateLimits.bufferedStepsPerSecond * STEP_RATE_MARGIN);
+    LOG_INFO("Step rate limits: %.0f steps/s for moves, %.0f steps/s for homing",
+        stepRateLimits.bufferedStepsPerSecond, stepRateLimits.directStepsPerSecond);
 }
 
 void processLEDOnCmd() // M3 or M106 turn on UV LED
@@ -145,6 +340,11 @@ void processLEDButon()
 
 void setup()
 {
+    startLogging();
+
+    // A control socket client that disconnects must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+
     // General GPIO initialization
     if (wiringPiSetupGpio () == -1)
         throw std::runtime_error("Cannot initialize GPIO");
@@ -154,7 +354,23 @@ void setup()
     stepper.setStepsPerMillimeter(STEPS_PER_MM);
     stepper.setSpeedInMillimetersPerSecond(DEFAULT_SPEED);
     stepper.setAccelerationInMillimetersPerSecondPerSecond(DEFAULT_ACCELERATION);
+    stepExecutor.connectToPins(STEP_PIN, DIR_PIN);
     pinMode(ENABLE_PIN, OUTPUT);
+
+    for(int i = 0; i < AUX_AXIS_COUNT; i++)
+    {
+        pinMode(AUX_STEP_PINS[i], OUTPUT);
+        pinMode(AUX_DIR_PINS[i], OUTPUT);
+        stepExecutor.connectAxis(i + 1, AUX_STEP_PINS[i], AUX_DIR_PINS[i], AUX_INVERT_DIR[i]);
+    }
+
+    // Step, direction and enable are configured as outputs through wiringPi
+    // above and driven through the selected backend from here on
+    if(!gpio.open(gpioBackend))
+    {
+        LOG_WARN("Cannot map /dev/gpiomem, driving the pins through wiringPi");
+        gpio.open(Gpio::GPIO_WIRINGPI);
+    }
     processMotorOffCmd();
 
 #if SUPPORT_UP_DOWN_BUTTONS
@@ -186,228 +402,817 @@ void setup()
     //ENDSTOPS
     pinMode(Z_STOP_PIN, INPUT);
     pullUpDnControl(Z_STOP_PIN, Z_STOP_PUD);
+#if ENDSTOP_MONITOR
+    if(!startEndstopMonitor(stepExecutor))
+        LOG_WARN("Cannot watch the endstops, they are only checked while homing");
+#endif
+
+#if STEP_RATE_PROBE
+    probeStepRate();
+#endif
+
+    if(!openStatusPage())
+        LOG_WARN("Cannot share the status page as %s, M114 still works", STATUS_PAGE_NAME);
+    publishMotionStatus(stepExecutor);
+
+#if HAS_THERM
+    startThermometer();
+#endif
+
+#if MOTION_THREAD
+    startMotionThread(stepExecutor);
+#endif
 }
 
-bool checkMCommand(const char * buf, char prefix)
+bool planMove(const PlannedMove & move) // Queue a move of every axis, completion is reported from serviceExecution(). False if it was dropped.
 {
-  const char * ptr = buf;
-  ptr = strchr(ptr, prefix);
-  if(ptr == NULL)
-  {
-    return false;
-  } else {
+    // Every planned move takes a completion slot, or the reports would drift
+    // from the moves that actually run
+    uint32_t clampedMoves = planner.getClampedMoves();
+    if(moveCompletions.full() || !planner.addMove(move.targets, move.speed, move.acceleration, move.jerk))
+    {
+        LOG_ERROR("Move dropped, the planner is full");
+        respond("Error: planner full, move dropped", BINARY_INVALID);
+
+        // Still complete, so a host waiting for Z_move_comp does not hang
+        respond("Z_move_comp", BINARY_MOVE_COMPLETE);
+        return false;
+    }
+    if(planner.getClampedMoves() != clampedMoves)
+        LOG_WARN("Speed %.2f mm/s clamped to %.2f mm/s", move.speed / move.scale, planner.getMaxSpeed() / move.scale);
+
+    processMotorOnCmd();
+    MoveCompletion * completion = moveCompletions.push();
+    completion->channel = responseChannel;
+    completion->seq = responseSeq;
+    completion->muted = muteResponses || !move.last;
+    executionState = EXEC_MOVING;
     return true;
-  }
 }
 
-int parseInt(const char * buf, char prefix, int value)
+MotionCommands motionCommands(planner, planMove);
+
+void processPauseCmd(int duration)
 {
-    const char * ptr = buf;
+    dwellStartMS = millis();
+    dwellDurationMS = duration;
+    executionState = EXEC_DWELLING;
+}
 
-    while(ptr && *ptr)
-    {
-        if(*ptr == prefix)
-            return atoi(ptr + 1);
+void handleMove(const GCodeCommand & cmd) // G1 Znnn Annn Bnnn Fnnn Jnnn - Move, J overrides the jerk for this move (J0 trapezoidal)
+{
+    motionCommands.move(cmd);
+}
 
-        ptr = strchr(ptr, ' ');
-        if(ptr == NULL)
-            break;
+static_assert(GCODE_MAX_LIST_LENGTH <= MotionPlanner::DEPTH, "Every peel segment must fit in the planner");
 
-        ptr++;
+void handlePeel(const GCodeCommand & cmd) // M810 Zd1:d2:... Ff1:f2:... - Run relative segments, each at its own speed, as one motion
+{
+    // Only the end of the last segment is reported
+    if(!motionCommands.peel(cmd))
+    {
+        // Still complete, so a host waiting for Z_move_comp does not hang
+        respond("Error: invalid peel segments", BINARY_INVALID);
+        respond("Z_move_comp", BINARY_MOVE_COMPLETE);
     }
-    return value;
 }
 
-float parseFloat(const char * buf, char prefix, float value)
+void handlePause(const GCodeCommand & cmd) // G4 Pause
 {
-    const char * ptr = buf;
+    processPauseCmd(cmd.getInt('P', 0));
+}
 
-    while(ptr && *ptr)
+void handleHome(const GCodeCommand &) // G28 Home, stepped by serviceHoming() while input is still served
+{
+    // Set direction, speed, travel, and endstop in Config.h
+    stepper.setJerkInMillimetersPerSecondPerSecondPerSecond(0);
+    stepper.setupHomeInMillimeters(HOME_DIR, directSpeedInMillimetersPerSecond(HOME_SPD), HOME_HEIGHT, Z_STOP_PIN);
+
+    homingCompletion.channel = responseChannel;
+    homingCompletion.seq = responseSeq;
+    homingCompletion.muted = muteResponses;
+    executionState = EXEC_HOMING;
+}
+
+void handleAbort(const GCodeCommand &) // M410 - Abort homing, the motor decelerates to a stop
+{
+    if(executionState == EXEC_HOMING)
+        stepper.abortHoming();
+}
+
+void handleEmergencyStop(const GCodeCommand &) // M112 - Decelerate to a stop, then drop every planned move and queued command
+{
+    processLEDOffCmd();
+    stepExecutor.hold(DEFAULT_ACCELERATION * STEPS_PER_MM);
+    if(executionState == EXEC_HOMING)
+        stepper.abortHoming();
+    if(executionState == EXEC_DWELLING)
+        executionState = EXEC_IDLE;
+
+    commandQueue.clear();
+    replayMacro = NULL;
+    if(jobRunning)
     {
-        if(*ptr == prefix)
-            return atof(ptr + 1);
+        jobFile.close();
+        jobRunning = false;
+        LOG_WARN("Job stopped after %zu commands", jobCommands);
+    }
 
-        ptr = strchr(ptr, ' ');
-        if(ptr == NULL)
-            break;
+    emergencyStop = STOP_DECELERATING;
+    emergencyStopCompletion.channel = responseChannel;
+    emergencyStopCompletion.seq = responseSeq;
+    emergencyStopCompletion.muted = false;
+}
 
-        ptr++;
+void handleFeedHold(const GCodeCommand &) // M25 - Decelerate to a stop mid-move and start nothing new until M24
+{
+    feedHold = true;
+    stepExecutor.hold(DEFAULT_ACCELERATION * STEPS_PER_MM);
+}
+
+void handleResume(const GCodeCommand &) // M24 - Resume the moves and commands held by M25
+{
+    if(!feedHold || emergencyStop != STOP_NONE)
+        return;
+
+    feedHold = false;
+    stepExecutor.resume();
+}
+
+void handleAbsolutePositioning(const GCodeCommand &) // G90 - Set Absolute Positioning
+{
+    motionCommands.setRelative(false);
+}
+
+void handleRelativePositioning(const GCodeCommand &) // G91 - Set Relative Positioning
+{
+    motionCommands.setRelative(true);
+}
+
+void handleSetJerk(const GCodeCommand & cmd) // M205 Jnnn - Set the jerk of following moves in mm/s^3, J0 for trapezoidal moves
+{
+    if(cmd.getFloat('J', 0) < 0)
+    {
+        respond("Error: invalid jerk", BINARY_INVALID);
+        return;
     }
-    return value;
+    motionCommands.setDefaultJerk(cmd.getFloat('J', 0));
 }
 
-void processMoveCmd(float position, float speed)
+void handleLEDOn(const GCodeCommand &) // M3 - UV LED On
 {
-    if(speed != 0)
-        stepper.setSpeedInMillimetersPerSecond(speed / 60);
+    processLEDOnCmd();
+}
 
-    if(relativePositioning)
-        stepper.moveRelativeInMillimeters(position);
+void handleFanOrLEDOn(const GCodeCommand & cmd) // M106 P1 Snnn - Fan PWM, plain M106 - UV LED On
+{
+    if(cmd.has('P'))
+    {
+        fanPwm = cmd.getFloat('S', 0);
+        pwmWrite(FAN_PIN, fanPwm);
+    }
     else
-        stepper.moveToPositionInMillimeters(position);
+        processLEDOnCmd();
 }
 
-void processPauseCmd(int duration)
+void handleLEDOff(const GCodeCommand &) // M5 - UV LED Off
 {
-    delay(duration);
+    processLEDOffCmd();
 }
 
-bool parseGCommand(const char * cmd)
+void handleFanOrLEDOff(const GCodeCommand & cmd) // M107 P1 - Fan off, plain M107 - UV LED Off
 {
-    int cmdID = parseInt(cmd, 'G', 0);
-    switch(cmdID)
+    if(cmd.has('P'))
     {
-        case 1: // G1 Move
-        {
-            float len = parseFloat(cmd, 'Z', 0);
-            float speed = parseFloat(cmd, 'F', 0);
-            processMotorOnCmd();
-            processMoveCmd(len, speed);
-            updateLastMovement();
+        fanPwm = 0;
+        pwmWrite(FAN_PIN, 0);
+    }
+    else
+        processLEDOffCmd();
+}
 
-            // NanoDLP waits for a confirmation that movement was completed
-            ptyWrite("Z_move_comp");
-            return true;
-        }
-        case 4: // G4 Pause
-        {
-            int duration = parseInt(cmd, 'P', 0);
-            processPauseCmd(duration);
-            return true;
-        }
-        case 28: // G28 Home
+void handleMotorOn(const GCodeCommand &) // M17 - Motor on
+{
+    processMotorOnCmd();
+}
+
+void handleMotorOff(const GCodeCommand &) // M18 - Motor off
+{
+    processMotorOffCmd();
+}
+
+void handleGetPosition(const GCodeCommand &) // M114 - Get current position, from the status page so it is answered mid-move too
+{
+    MotionStatus status = statusPage().motion.read();
+    char text[64];
+    int length = snprintf(text, sizeof(text), "Z:%.3f", status.positionInMillimeters);
+    for(int i = 0; i < AUX_AXIS_COUNT; i++)
+        length += snprintf(text + length, sizeof(text) - length, " %c:%.3f", AUX_AXIS_LETTERS[i], status.axisPositionsInSteps[i] / AUX_STEPS_PER_UNIT[i]);
+    respond(text, BINARY_POSITION);
+}
+
+void handleBuzzer(const GCodeCommand & cmd) // M300 Snnn - Sound buzzer
+{
+    #if SUPPORT_BUZZER
+    if(cmd.has('S'))
+    {
+        long i = millis();
+        float len = cmd.getFloat('S', 0);
+        long j = i+len;
+        while(islessequal(i,j))
         {
-          // Set direction, speed, travel, and endstop in Config.h
-          stepper.moveToHomeInMillimeters(HOME_DIR, HOME_SPD, HOME_HEIGHT, Z_STOP_PIN);
-          ptyWrite("Z_move_comp");
-          updateLastMovement();
+            digitalWrite(BUZZ_PIN,1);
         }
-        case 90: // G90 - Set Absolute Positioning
-            relativePositioning = false;
-            return true;
+        digitalWrite(BUZZ_PIN,0);
+    }
+    #else
+    (void)cmd;
+    #endif
+}
 
-        case 91: // G91 - Set Relative Positioning
-            relativePositioning = true;
-            return true;
+void handleBinaryMode(const GCodeCommand & cmd) // M1000 - Binary framing on (S1, default) or off (S0) for this channel
+{
+    LineChannel * channel = findChannel(responseChannel);
+    if(channel == NULL)
+        return;
+
+    if(cmd.getInt('S', 1))
+        channel->setFrameMode(sizeof(BinaryRequest), BINARY_SYNC);
+    else
+        channel->setLineMode();
+}
 
+void handleRecordMacro(const GCodeCommand & cmd) // M800 Pn - Record the following commands from this channel as macro n
+{
+    int id = cmd.getInt('P', -1);
+    if(macros.find(id) == NULL)
+    {
+        respond("Error: invalid macro number", BINARY_INVALID);
+        return;
     }
 
-    return false;
+    // Rewriting it would cut short or corrupt the replay in progress
+    if(replayMacro == macros.find(id))
+    {
+        respond("Error: macro is being replayed", BINARY_INVALID);
+        return;
+    }
+
+    macros.start(id);
+    recordingChannel = responseChannel;
 }
 
-bool parseMCommand(const char * cmd)
+void handleEndMacro(const GCodeCommand &) // M801 - Stop recording
 {
-    int cmdID = parseInt(cmd, 'M', 0);
-    switch(cmdID)
+    macros.stop();
+    recordingChannel = -1;
+}
+
+void handleReplayMacro(const GCodeCommand & cmd) // M802 Pn - Run macro n
+{
+    const Macro * macro = macros.find(cmd.getInt('P', -1));
+    if(macro == NULL)
     {
+        // Still complete, so a host waiting for Z_move_comp does not hang
+        respond("Error: invalid macro number", BINARY_INVALID);
+        respond("Z_move_comp", BINARY_MOVE_COMPLETE);
+        return;
+    }
 
-        case 3:// M3/M106 - UV LED On
+    replayMacro = macro;
+    replayIndex = 0;
+    replayChannel = responseChannel;
+    replaySeq = responseSeq;
+}
+
+void handleStepRate(const GCodeCommand & cmd) // M850 - Report the step rate limits and how many moves were clamped, S1 measures them again first
+{
+    if(cmd.getInt('S', 0) == 1)
+    {
+        // The probe pulses the real step pin with the driver off, so Z would
+        // lose its holding torque in the middle of a job
+        bool motorEnabled = !gpio.read(ENABLE_PIN);
+        if(motorEnabled || jobRunning || replayMacro != NULL || executionState != EXEC_IDLE)
         {
-            processLEDOnCmd();
-            return true;
+            respond("Error: M850 S1 needs the motor disabled (M18) and no job, macro or move running", BINARY_INVALID);
+            return;
         }
+        probeStepRate();
+    }
+
+    stringstream s;
+    s << std::fixed << std::setprecision(0)
+      << "Step rate: moves " << stepRateLimits.bufferedStepsPerSecond << " steps/s"
+      << ", homing " << stepRateLimits.directStepsPerSecond << " steps/s"
+      << ", max speed " << std::setprecision(2) << planner.getMaxSpeed() / STEPS_PER_MM << " mm/s"
+      << ", " << planner.getClampedMoves() << " moves clamped";
+    respond(s.str(), BINARY_OK);
+}
 
-        case 106:
+bool startJob(const char * path, int channel) // Start streaming a G-code file into the command queue
+{
+    if(jobRunning || !jobFile.open(path))
+        return false;
+
+    LOG_INFO("Running %s", path);
+    jobRunning = true;
+    jobChannel = channel;
+    jobStartMS = millis();
+    jobCommands = 0;
+    return true;
+}
+
+void handleRunFile(const GCodeCommand & cmd) // M32 <path> - Run a G-code file from the Pi's filesystem
+{
+    string path(cmd.text ? cmd.text : "", cmd.textLength);
+    if(path.empty() || !startJob(path.c_str(), responseChannel))
+        respond("Error: cannot run file", BINARY_INVALID);
+}
+
+bool decodeBinaryRequest(const BinaryRequest & request, GCodeCommand & cmd)
+{
+    if(request.wordCount > BINARY_MAX_WORDS)
+        return false;
+
+    cmd.clear();
+    cmd.letter = request.letter;
+    cmd.code = request.code;
+    for(int i = 0; i < request.wordCount; i++)
+    {
+        if(!cmd.set(request.wordLetters[i], request.wordValues[i]))
+            return false;
+    }
+
+    return true;
+}
+
+const CommandEntry * dispatchCommand(int channel, bool parsed, GCodeCommand & cmd, const char * received, int receivedLength) // Validate a received command and queue, record or run it, NULL if it was rejected
+{
+    responseChannel = channel;
+
+    const CommandEntry * entry = parsed ? findCommand(cmd) : NULL;
+    if(entry == NULL)
+    {
+        LOG_DEBUG("Received line: %.*s", receivedLength, received);
+        string s("Invalid or unsupported command: ");
+        s.append(received, receivedLength < 0 ? strlen(received) : receivedLength);
+        respond(s, BINARY_INVALID);
+        return NULL;
+    }
+
+    if(channel == recordingChannel && macros.records(entry))
+    {
+        // Validated and parsed now, executed only when the macro is replayed
+        if(!macros.record(cmd, entry))
         {
-            if(checkMCommand(cmd, 'P'))
-            {
-                float spd = parseFloat(cmd, 'S', 0);
-                pwmWrite(FAN_PIN, spd);
-            } else {
-                processLEDOnCmd();
-                return true;
-            }
+            LOG_DEBUG("Received line: %.*s", receivedLength, received);
+            respond("Error: command cannot be added to macro", BINARY_INVALID);
+            return NULL;
         }
-
-        case 5: // M5/M107 - UV LED Off
+    }
+    else if(entry->immediate)
+        entry->handler(cmd);
+    else
+    {
+        QueuedCommand * queued = commandQueue.push();
+        if(queued == NULL)
         {
-            processLEDOffCmd();
-            return true;
+            LOG_DEBUG("Received line: %.*s", receivedLength, received);
+            respond("Error: command queue full", BINARY_INVALID);
+            return NULL;
         }
+        queued->cmd = cmd;
+        queued->entry = entry;
+        queued->channel = channel;
+        queued->seq = responseSeq;
+    }
+
+    // Logged once the command is on its way, never in front of it
+    LOG_DEBUG("Received line: %.*s", receivedLength, received);
+
+    // Answered in the framing the channel uses from now on, so M1000 is
+    // confirmed with a binary frame and M1000 S0 with a text "ok"
+    respond("ok", BINARY_OK);
+    return entry;
+}
+
+bool acceptCommand(LineChannel & channel, const CommandEntry ** dispatched = NULL) // Read one line or frame from a channel and dispatch it
+{
+    GCodeCommand cmd;
+    const char * received;
+    char frameName[16];
+    bool parsed;
+
+    if(channel.isFrameMode())
+    {
+        BinaryRequest request;
+        if(!channel.nextFrame(&request))
+            return false;
+
+        parsed = decodeBinaryRequest(request, cmd);
+        snprintf(frameName, sizeof(frameName), "%c%u", request.letter, request.code);
+        received = frameName;
+        responseSeq = request.seq;
+    }
+    else
+    {
+        received = channel.nextLine();
+        if(received == NULL)
+            return false;
+
+        parsed = parseGCodeLine(received, cmd);
+        responseSeq = 0;
+    }
+
+    const CommandEntry * entry = dispatchCommand(channel.id(), parsed, cmd, received, -1);
+    if(dispatched != NULL)
+        *dispatched = entry;
+    return true;
+}
+
+void dropCommand(LineChannel & channel) // Read one line or frame from a channel and answer it without running it
+{
+    responseChannel = channel.id();
+    responseSeq = 0;
+
+    if(channel.isFrameMode())
+    {
+        BinaryRequest request;
+        if(!channel.nextFrame(&request))
+            return;
+        responseSeq = request.seq;
+    }
+    else if(channel.nextLine() == NULL)
+        return;
+
+    respond("Error: dropped by emergency stop", BINARY_INVALID);
+}
+
+bool isOvertakingLine(const char * data, size_t) // Input filter, the line ends at its newline
+{
+    GCodeCommand cmd;
+    if(!parseGCodeLine(data, cmd))
+        return false;
+
+    const CommandEntry * entry = findCommand(cmd);
+    return entry != NULL && entry->overtakes;
+}
+
+bool isOvertakingFrame(const char * data, size_t size)
+{
+    BinaryRequest request;
+    GCodeCommand cmd;
+    if(size != sizeof(request))
+        return false;
+
+    memcpy(&request, data, sizeof(request));
+    if(!decodeBinaryRequest(request, cmd))
+        return false;
+
+    const CommandEntry * entry = findCommand(cmd);
+    return entry != NULL && entry->overtakes;
+}
+
+void acceptOvertakingCommands(LineChannel & channel) // With the command queue full, still take M112, M25 and the like from behind the lines waiting for space
+{
+    for(;;)
+    {
+        int overtaken = channel.promote(channel.isFrameMode() ? isOvertakingFrame : isOvertakingLine);
+        if(overtaken < 0)
+            return;
 
-        case 107:
+        const CommandEntry * entry = NULL;
+        acceptCommand(channel, &entry);
+
+        // Lines sent before M112 are dropped like the queued commands
+        if(entry != NULL && entry->handler == handleEmergencyStop)
         {
-            if(checkMCommand(cmd, 'P'))
-            {
-                pwmWrite(FAN_PIN, 0);
-            } else {
-            processLEDOffCmd();
-            return true;
-            }
+            for(int i = 0; i < overtaken; i++)
+                dropCommand(channel);
         }
+    }
+}
+
+bool acceptFileCommand() // Read one line of the running job file and dispatch it
+{
+    if(!jobFile.isOpen())
+        return false;
+
+    size_t length;
+    const char * line = jobFile.nextLine(length);
+    if(line == NULL)
+    {
+        jobFile.close();
+        return false;
+    }
+
+    // Blank and comment-only lines are normal in job files
+    const char * ptr = line;
+    while(ptr < line + length && *ptr == ' ')
+        ptr++;
+    if(ptr == line + length || *ptr == ';' || *ptr == '(')
+        return true;
+
+    GCodeCommand cmd;
+    bool parsed = parseGCodeLine(line, cmd);
+    responseSeq = 0;
+    jobCommands++;
+    dispatchCommand(FILE_CHANNEL, parsed, cmd, line, (int)length);
+    return true;
+}
+
+void serviceJob() // Report a job file as done once all of its commands have run
+{
+    if(!jobRunning || jobFile.isOpen() || !commandQueue.empty() || executionState != EXEC_IDLE || replayMacro != NULL)
+        return;
+
+    jobRunning = false;
+    jobElapsedMS = millis() - jobStartMS;
+    LOG_INFO("Job finished: %zu commands in %lu ms", jobCommands, jobElapsedMS);
+
+    responseChannel = jobChannel;
+    responseSeq = 0;
+    respond("Done printing file", BINARY_OK);
+}
+
+void acceptCommands() // Take one line from each channel in turn so no source can starve another
+{
+    bool accepted = true;
+    while(accepted && !commandQueue.full())
+    {
+        accepted = pty && acceptCommand(pty->channel());
+
+        for(size_t i = 0; controlSocket && i < controlSocket->clientCount() && !commandQueue.full(); i++)
+            accepted |= acceptCommand(controlSocket->client(i));
+
+        if(!commandQueue.full())
+            accepted |= acceptFileCommand();
+    }
+
+    // Only queued commands wait for space, the ones that act on the motion
+    // must not sit behind a long job
+    if(commandQueue.full())
+    {
+        if(pty)
+            acceptOvertakingCommands(pty->channel());
+        for(size_t i = 0; controlSocket && i < controlSocket->clientCount(); i++)
+            acceptOvertakingCommands(controlSocket->client(i));
+    }
+
+    if(controlSocket)
+        controlSocket->reap();
+}
+
+bool nextCommandIsMove() // True if the next macro step or queued command is a G1 the planner can blend in
+{
+    if(planner.full() || moveCompletions.full())
+        return false;
 
-        case 17: // M17 - Motor on
+    if(replayMacro != NULL)
+        return replayIndex < replayMacro->count && replayMacro->entries[replayIndex]->handler == handleMove;
+
+    return !commandQueue.empty() && commandQueue.front().entry->handler == handleMove;
+}
+
+void serviceMotion() // Render and step the planned moves, report each one as it completes
+{
+    planner.render(stepBuffer, RENDER_AHEAD_US);
+#if !MOTION_THREAD
+    stepExecutor.process();
+#endif
+
+    while(!moveCompletions.empty() && stepExecutor.getCompletedMoves() != reportedMoves)
+    {
+        // NanoDLP waits for a confirmation that movement was completed
+        MoveCompletion & completion = moveCompletions.front();
+        if(!completion.muted)
         {
-            processMotorOnCmd();
-            return true;
+            responseChannel = completion.channel;
+            responseSeq = completion.seq;
+            respond("Z_move_comp", BINARY_MOVE_COMPLETE);
         }
+        moveCompletions.pop();
+        reportedMoves++;
+    }
 
-        case 18: // M18 - Motor off
+    if(moveCompletions.empty())
+    {
+        // Steps dropped at an endstop never moved the motor, plan on from
+        // where it stopped
+        if(stepExecutor.getDroppedSteps() != syncedDroppedSteps)
         {
-            processMotorOffCmd();
-            return true;
+            LOG_WARN("%u steps dropped at a closed endstop", stepExecutor.getDroppedSteps() - syncedDroppedSteps);
+            syncedDroppedSteps = stepExecutor.getDroppedSteps();
+            syncPlannerPosition();
         }
 
-        case 114: // M114 - Get current position
+        updateLastMovement();
+        executionState = EXEC_IDLE;
+    }
+}
+
+void serviceEndstops() // Report endstops closed by a move, on the channel of the move that ran into it
+{
+    EndstopTrip trip;
+    while(takeEndstopTrip(trip))
+    {
+        // Homing closes its switch on purpose
+        if(executionState == EXEC_HOMING)
+            continue;
+
+        responseChannel = moveCompletions.empty() ? PTY_CHANNEL : moveCompletions.front().channel;
+        responseSeq = 0;
+        stringstream s;
+        s << "Error: endstop on pin " << trip.pin << " hit at " << trip.time_InUS << "us, Z:"
+          << std::fixed << std::setprecision(3) << trip.positionInSteps / STEPS_PER_MM;
+        respond(s.str(), BINARY_INVALID);
+        LOG_WARN("%s", s.str().c_str());
+    }
+}
+
+void serviceHoming() // Step homing, and report it like a move once it has finished
+{
+    // The executor is idle, its position only feeds the status page
+    bool finished = stepper.processHoming();
+    stepExecutor.setPositionInSteps(stepper.getCurrentPositionInSteps());
+    if(!finished)
+        return;
+
+    syncExecutorPosition();
+    updateLastMovement();
+    executionState = EXEC_IDLE;
+
+    responseChannel = homingCompletion.channel;
+    responseSeq = homingCompletion.seq;
+    muteResponses = homingCompletion.muted;
+    if(!stepper.homingSucceeded())
+        respond("Error: homing failed", BINARY_INVALID);
+    respond("Z_move_comp", BINARY_MOVE_COMPLETE);
+    muteResponses = false;
+}
+
+void serviceEmergencyStop() // Once the motor has stopped, drop the planned moves without reporting them
+{
+    // Aborted homing decelerates on its own
+    if(executionState == EXEC_HOMING)
+    {
+        serviceHoming();
+        return;
+    }
+
+    if(emergencyStop == STOP_DECELERATING)
+    {
+        // Rendering goes on, the buffered steps may be too few to stop in
+        if(executionState == EXEC_MOVING)
         {
-            float pos = stepper.getCurrentPositionInMillimeters();
-            stringstream s;
-            s << "Z:" << std::setprecision(2) << pos;
-            ptyWrite(s.str());
-            return true;
+            serviceMotion();
+            if(executionState == EXEC_MOVING && !stepExecutor.isHeld())
+                return;
         }
 
-        case 300:
-        {   
-            #if SUPPORT_BUZZER
-            if(checkMCommand(cmd, 'S'))
-            {
-                long i = millis();
-                float len = parseFloat(cmd, 'S', 0);
-                long j = i+len;
-                while(islessequal(i,j))
-                {
-                    digitalWrite(BUZZ_PIN,1);
-                }
-                digitalWrite(BUZZ_PIN,0);
-            }
-            #endif
-            return true;
-        }        
+        planner.clear();
+        stepExecutor.requestFlush();
+        emergencyStop = STOP_FLUSHING;
     }
-    return false;
+
+#if !MOTION_THREAD
+    stepExecutor.process();
+#endif
+    if(stepExecutor.flushPending())
+        return;
+
+    moveCompletions.clear();
+    reportedMoves = stepExecutor.getCompletedMoves();
+    syncedDroppedSteps = stepExecutor.getDroppedSteps();
+    syncPlannerPosition();
+    updateLastMovement();
+    executionState = EXEC_IDLE;
+
+    emergencyStop = STOP_NONE;
+    feedHold = false;
+    stepExecutor.resume();
+
+    responseChannel = emergencyStopCompletion.channel;
+    responseSeq = emergencyStopCompletion.seq;
+    stringstream s;
+    s << "Emergency stop, Z:" << std::fixed << std::setprecision(3) << currentPositionInMillimeters();
+    respond(s.str(), BINARY_OK);
+    LOG_WARN("%s", s.str().c_str());
 }
 
-bool parseCommand(const char * cmd)
+void serviceExecution() // Advance the running moves, homing or dwell, then start macro steps or queued commands
 {
-    switch(*cmd)
+    if(emergencyStop != STOP_NONE)
     {
-    case 'G':
-        return parseGCommand(cmd);
+        serviceEmergencyStop();
+        return;
+    }
 
-    case 'M':
-        return parseMCommand(cmd);
+    if(executionState == EXEC_MOVING)
+        serviceMotion();
 
-    default:
-        break;
+    if(executionState == EXEC_HOMING)
+        serviceHoming();
+
+    if(executionState == EXEC_DWELLING)
+    {
+        if(millis() - dwellStartMS < dwellDurationMS)
+            return;
+
+        executionState = EXEC_IDLE;
     }
 
-    return false;
+    // Held moves stay planned, nothing new starts
+    if(feedHold)
+        return;
+
+    // Moves are handed to the planner while the ones before them still run
+    while(executionState == EXEC_IDLE || (executionState == EXEC_MOVING && nextCommandIsMove()))
+    {
+        if(replayMacro != NULL)
+        {
+            if(replayIndex < replayMacro->count)
+            {
+                muteResponses = true;
+                replayMacro->entries[replayIndex]->handler(replayMacro->cmds[replayIndex]);
+                muteResponses = false;
+                replayIndex++;
+                continue;
+            }
+
+            // One acknowledgement for the whole sequence
+            replayMacro = NULL;
+            responseChannel = replayChannel;
+            responseSeq = replaySeq;
+            respond("Z_move_comp", BINARY_MOVE_COMPLETE);
+            continue;
+        }
+
+        if(commandQueue.empty())
+            break;
+
+        responseChannel = commandQueue.front().channel;
+        responseSeq = commandQueue.front().seq;
+        commandQueue.front().entry->handler(commandQueue.front().cmd);
+        commandQueue.pop();
+    }
 }
 
-int main(int argc, char** argv)
+void publishMachineStatus() // Main loop state into the status page, the motion thread writes its own block
 {
-    setup();
+    MachineStatus status = {};
+    status.time_InUS = micros();
+    status.targetInMillimeters = planner.getEndPositionInSteps() / (float)STEPS_PER_MM;
+    status.temperatureInCelsius = getTemperatureInCelsius();
+    status.fanPwm = fanPwm;
+    status.uvLedOn = digitalRead(UV_LED_PIN);
+    status.motorEnabled = !gpio.read(ENABLE_PIN);
+    status.executionState = executionState;
+    status.feedHold = feedHold;
+    status.emergencyStop = emergencyStop != STOP_NONE;
+    status.jobRunning = jobRunning;
+    status.queuedCommands = commandQueue.size();
+    statusPage().machine.write(status);
+}
 
-    while(1)
+bool steppingInLoop() // True while this loop takes the steps, rather than the motion thread
+{
+#if MOTION_THREAD
+    return executionState == EXEC_HOMING;
+#else
+    return executionState == EXEC_MOVING || executionState == EXEC_HOMING;
+#endif
+}
+
+void serviceLoop() // One pass of the main loop: motion, buttons, then input
+{
+    //checkAlive();
+
+    serviceExecution();
+    serviceEndstops();
+    serviceJob();
+
+    static unsigned long lastPollUS = micros();
+    if(steppingInLoop())
     {
-        //checkAlive();
+        if(micros() - lastPollUS < IO_POLL_INTERVAL_US)
+            return;
+    }
+    lastPollUS = micros();
 
+#if !MOTION_THREAD
+    publishMotionStatus(stepExecutor);
+#endif
+    publishMachineStatus();
+
+    if(executionState == EXEC_IDLE)
+    {
         #if SUPPORT_UP_DOWN_BUTTONS
         if(isButtonPressed(UP_BTN_PIN))
         {
             processMotorOnCmd();
             processBtnMovement(UP_BTN_PIN, 1);
+            syncExecutorPosition();
             updateLastMovement();
         }
 
@@ -415,6 +1220,7 @@ int main(int argc, char** argv)
         {
             processMotorOnCmd();
             processBtnMovement(DOWN_BTN_PIN, -1);
+            syncExecutorPosition();
             updateLastMovement();
         }
         #endif //SUPPORT_UP_DOWN_BUTTONS
@@ -423,29 +1229,77 @@ int main(int argc, char** argv)
         if(isButtonPressed(LED_ON_BTN_PIN))
             processLEDButon();
         #endif //SUPPORT_LED_ON_BUTTON
-        
-        string cmd;
 
-        if(pty.receiveNextString(cmd))
-        {
-            cout << "Received line: " << cmd << endl;
-
-            if(parseCommand(cmd.c_str()))
+        if(shouldDisableMotors() && !gpio.read(ENABLE_PIN))
             {
-                ptyWrite("ok");
+                processMotorOffCmd();
             }
+    }
+
+    // With the motion thread the renderer only has to come back well within
+    // RENDER_AHEAD_US. Wait up to 1ms for input unless this loop is stepping
+    // or streaming from a file, then queue every complete line received.
+    eventLoop.poll(steppingInLoop() || jobFile.isOpen() ? 0 : 1);
+    acceptCommands();
+}
+
+int usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [--run file.gcode] [--gpio wiringpi|gpiomem|sim]\n", program);
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    const char * jobPath = NULL;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--run") == 0 && i + 1 < argc)
+            jobPath = argv[++i];
+        else if(strcmp(argv[i], "--gpio") == 0 && i + 1 < argc)
+        {
+            const char * backend = argv[++i];
+            if(strcmp(backend, "wiringpi") == 0)
+                gpioBackend = Gpio::GPIO_WIRINGPI;
+            else if(strcmp(backend, "gpiomem") == 0)
+                gpioBackend = Gpio::GPIO_GPIOMEM;
+            else if(strcmp(backend, "sim") == 0)
+                gpioBackend = Gpio::GPIO_SIMULATED;
             else
             {
-                string s("Invalid or unsupported command: ");
-                s += cmd;
-                ptyWrite(s);
+                fprintf(stderr, "Unknown GPIO backend %s\n", backend);
+                return usage(argv[0]);
             }
         }
+        else
+            return usage(argv[0]);
+    }
 
-        if(shouldDisableMotors() && !digitalRead(ENABLE_PIN))
-            {
-                processMotorOffCmd();
-            } 
+    setup();
+
+    // Run a job file straight through the parser and motion code, then exit
+    if(jobPath != NULL)
+    {
+        if(!startJob(jobPath, FILE_CHANNEL))
+        {
+            fprintf(stderr, "Cannot open %s\n", jobPath);
+            return 1;
+        }
+
+        while(jobRunning)
+            serviceLoop();
+
+        processMotorOffCmd();
+        flushLogging();
+
+        // Debug logging can drop messages on fast jobs, so always print the summary
+        printf("Job finished: %zu commands in %lu ms\n", jobCommands, jobElapsedMS);
+        return 0;
     }
-    
+
+    pty.reset(new HostPty(eventLoop, "/tmp/ttyNanoDLP", PTY_CHANNEL));
+    controlSocket.reset(new ControlSocket(eventLoop, "/tmp/NanoDLPShield.sock", PTY_CHANNEL + 1));
+
+    while(1)
+        serviceLoop();
 }
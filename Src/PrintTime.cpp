@@ -0,0 +1,334 @@
+#include "SpeedyStepper.h"
+#include "MotionPlanner.h"
+#include "Commands.h"
+#include "MotionCommands.h"
+#include "MacroStore.h"
+#include "GCodeCommand.h"
+#include "GCodeFile.h"
+#include "Config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+// Estimates how long a G-code job takes without a printer. The job goes
+// through the same parser, planner and ramp maths as on the shield, but each
+// planned move is timed in closed form instead of being stepped, so a job of
+// thousands of layers takes milliseconds. A layer starts each time the UV LED
+// is switched on. Commands that take no time on the printer are counted and
+// reported as not timed, commands the shield does not support are skipped.
+
+SpeedyStepper stepper;
+MotionPlanner planner(stepper);
+
+struct Layer
+{
+    double moveSeconds;
+    double dwellSeconds;
+    size_t moves;
+};
+
+vector<Layer> layers(1);        // layers[0] is everything before the first exposure
+size_t dwellCount = 0;
+size_t homeCount = 0;
+size_t invalidLines = 0;
+map<float, size_t> speedCounts; // moves per speed in mm/min
+map<pair<char, int>, size_t> untimedCounts; // commands taken as instant, per letter and code
+map<pair<char, int>, size_t> unsupportedCounts; // commands the shield rejects, per letter and code
+size_t rejectedMacroCommands = 0;
+
+// Recorded like on the shield, so the per-layer peels NanoDLP replays with
+// M802 are timed
+MacroStore macros(handleReplayMacro);
+
+double seconds(const timespec & start, const timespec & end)
+{
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void timeFrontMove()
+{
+    layers.back().moveSeconds += planner.takeMoveTimeInSeconds();
+}
+
+void drainPlanner()
+{
+    while(!planner.empty())
+        timeFrontMove();
+}
+
+bool planMove(const PlannedMove & move)
+{
+    if(planner.full())
+        timeFrontMove();
+
+    planner.addMove(move.targets, move.speed, move.acceleration, move.jerk);
+    speedCounts[move.speed / move.scale * 60]++;
+    layers.back().moves++;
+    return true;
+}
+
+MotionCommands motionCommands(planner, planMove);
+
+void handleMove(const GCodeCommand & cmd) // G1 Znnn Annn Bnnn Fnnn Jnnn
+{
+    motionCommands.move(cmd);
+}
+
+void handlePeel(const GCodeCommand & cmd) // M810 Zd1:d2:... Ff1:f2:...
+{
+    motionCommands.peel(cmd);
+}
+
+void handlePause(const GCodeCommand & cmd) // G4 Pnnn
+{
+    layers.back().dwellSeconds += cmd.getInt('P', 0) / 1000.0;
+    dwellCount++;
+}
+
+void handleHome(const GCodeCommand &) // G28, its length depends on where the endstop is found
+{
+    planner.setPositionInSteps(0);
+    homeCount++;
+}
+
+void handleAbsolutePositioning(const GCodeCommand &) // G90
+{
+    motionCommands.setRelative(false);
+}
+
+void handleRelativePositioning(const GCodeCommand &) // G91
+{
+    motionCommands.setRelative(true);
+}
+
+void handleSetJerk(const GCodeCommand & cmd) // M205 Jnnn
+{
+    if(cmd.getFloat('J', 0) >= 0)
+        motionCommands.setDefaultJerk(cmd.getFloat('J', 0));
+}
+
+void handleLEDOn(const GCodeCommand &) // M3
+{
+    layers.push_back(Layer());
+}
+
+void handleFanOrLEDOn(const GCodeCommand & cmd) // M106, with P it is the fan
+{
+    if(!cmd.has('P'))
+        handleLEDOn(cmd);
+}
+
+void countUntimed(const GCodeCommand & cmd)
+{
+    untimedCounts[make_pair(cmd.letter, cmd.code)]++;
+}
+
+// Taken as instant
+void handleLEDOff(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleMotorOn(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleMotorOff(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleFanOrLEDOff(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleEmergencyStop(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleGetPosition(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleResume(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleFeedHold(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleRunFile(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleBuzzer(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleAbort(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleStepRate(const GCodeCommand & cmd) { countUntimed(cmd); }
+void handleBinaryMode(const GCodeCommand & cmd) { countUntimed(cmd); }
+
+void handleRecordMacro(const GCodeCommand & cmd) // M800 Pn
+{
+    if(!macros.start(cmd.getInt('P', -1)))
+        rejectedMacroCommands++;
+}
+
+void handleEndMacro(const GCodeCommand &) // M801
+{
+    macros.stop();
+}
+
+void runEntry(const CommandEntry * entry, const GCodeCommand & cmd) // The shield lets moves finish before any command but G1 runs
+{
+    if(entry->handler != handleMove)
+        drainPlanner();
+    entry->handler(cmd);
+}
+
+void handleReplayMacro(const GCodeCommand & cmd) // M802 Pn
+{
+    const Macro * macro = macros.find(cmd.getInt('P', -1));
+    if(macro == NULL)
+    {
+        rejectedMacroCommands++;
+        return;
+    }
+
+    for(int i = 0; i < macro->count; i++)
+        runEntry(macro->entries[i], macro->cmds[i]);
+}
+
+void runCommand(const GCodeCommand & cmd)
+{
+    const CommandEntry * entry = findCommand(cmd);
+    if(entry == NULL)
+    {
+        unsupportedCounts[make_pair(cmd.letter, cmd.code)]++;
+        return;
+    }
+
+    if(macros.records(entry))
+    {
+        if(!macros.record(cmd, entry))
+            rejectedMacroCommands++;
+        return;
+    }
+
+    runEntry(entry, cmd);
+}
+
+bool runFile(const char * path) // Times every command of the file, false if it cannot be opened
+{
+    GCodeFile file;
+    if(!file.open(path))
+        return false;
+
+    size_t length;
+    const char * line;
+    while((line = file.nextLine(length)) != NULL)
+    {
+        const char * ptr = line;
+        while(ptr < line + length && *ptr == ' ')
+            ptr++;
+        if(ptr == line + length || *ptr == ';' || *ptr == '(')
+            continue;
+
+        GCodeCommand cmd;
+        if(parseGCodeLine(line, cmd))
+            runCommand(cmd);
+        else
+            invalidLines++;
+    }
+
+    drainPlanner();
+    return true;
+}
+
+void printDuration(const char * label, double duration)
+{
+    long total = lround(duration);
+    printf("%s%ldh %02ldm %02lds (%.1f s)\n", label, total / 3600, total / 60 % 60, total % 60, duration);
+}
+
+void printReport(bool perLayer, double analysisSeconds)
+{
+    Layer sum = {};
+    for(size_t i = 0; i < layers.size(); i++)
+    {
+        sum.moveSeconds += layers[i].moveSeconds;
+        sum.dwellSeconds += layers[i].dwellSeconds;
+        sum.moves += layers[i].moves;
+    }
+
+    if(perLayer)
+    {
+        printf("%6s %10s %10s %10s %6s\n", "layer", "total_s", "moves_s", "dwells_s", "moves");
+        for(size_t i = 0; i < layers.size(); i++)
+        {
+            const Layer & layer = layers[i];
+            if(i == 0 && layer.moves == 0 && layer.dwellSeconds == 0)
+                continue;
+            printf("%6zu %10.3f %10.3f %10.3f %6zu\n", i, layer.moveSeconds + layer.dwellSeconds,
+                layer.moveSeconds, layer.dwellSeconds, layer.moves);
+        }
+        printf("\n");
+    }
+
+    printDuration("Total:  ", sum.moveSeconds + sum.dwellSeconds);
+    printf("Layers: %zu", layers.size() - 1);
+    if(layers.size() > 1)
+        printf(", %.3f s on average", (sum.moveSeconds + sum.dwellSeconds - layers[0].moveSeconds - layers[0].dwellSeconds) / (layers.size() - 1));
+    printf("\n");
+    printf("Moves:  %zu taking %.1f s\n", sum.moves, sum.moveSeconds);
+    printf("Dwells: %zu taking %.1f s\n", dwellCount, sum.dwellSeconds);
+
+    printf("Speeds:");
+    for(map<float, size_t>::const_iterator it = speedCounts.begin(); it != speedCounts.end(); ++it)
+        printf(" %g mm/min x %zu%s", it->first, it->second, next(it) == speedCounts.end() ? "" : ",");
+    printf("\n");
+
+    if(planner.getClampedMoves() > 0)
+        printf("Clamped: %u moves to %g mm/min\n", planner.getClampedMoves(), planner.getMaxSpeed() / STEPS_PER_MM * 60);
+#if STEP_RATE_PROBE
+    if(planner.getMaxSpeed() == 0)
+        printf("Speeds not clamped, pass the max speed M850 reports as --max-speed to clamp them like the shield\n");
+#endif
+
+    if(homeCount > 0)
+        printf("Homing: %zu G28 not included, its length depends on the endstop\n", homeCount);
+    if(!untimedCounts.empty())
+    {
+        printf("Not timed, taken as instant:");
+        for(map<pair<char, int>, size_t>::const_iterator it = untimedCounts.begin(); it != untimedCounts.end(); ++it)
+            printf(" %c%d x %zu%s", it->first.first, it->first.second, it->second, next(it) == untimedCounts.end() ? "" : ",");
+        printf("\n");
+    }
+    if(!unsupportedCounts.empty())
+    {
+        printf("Not supported by the shield, skipped:");
+        for(map<pair<char, int>, size_t>::const_iterator it = unsupportedCounts.begin(); it != unsupportedCounts.end(); ++it)
+            printf(" %c%d x %zu%s", it->first.first, it->first.second, it->second, next(it) == unsupportedCounts.end() ? "" : ",");
+        printf("\n");
+    }
+    if(rejectedMacroCommands > 0)
+        printf("Macros: %zu commands refused like on the shield, not timed\n", rejectedMacroCommands);
+    if(invalidLines > 0)
+        printf("Skipped %zu lines that are not G or M commands\n", invalidLines);
+    printf("Analysed in %.1f ms\n", analysisSeconds * 1000);
+}
+
+int usage(const char * program)
+{
+    fprintf(stderr, "Usage: %s [--summary] [--max-speed mm/s] file.gcode\n", program);
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    const char * path = NULL;
+    bool perLayer = true;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--summary") == 0)
+            perLayer = false;
+        else if(strcmp(argv[i], "--max-speed") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0)
+            planner.setMaxSpeed(atof(argv[++i]) * STEPS_PER_MM);
+        else if(path == NULL && argv[i][0] != '-')
+            path = argv[i];
+        else
+            return usage(argv[0]);
+    }
+
+    if(path == NULL)
+        return usage(argv[0]);
+
+    timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if(!runFile(path))
+    {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printReport(perLayer, seconds(start, end));
+    return 0;
+}
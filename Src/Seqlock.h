@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+// One writer and any number of readers, which never hold the writer up. The
+// writer makes the sequence odd while it copies a new value in. A reader
+// copies the value out and tries again if the sequence was odd or changed
+// meanwhile. T must be trivially copyable. Both the sequence and the value
+// live inline, so a Seqlock can be placed in memory shared with other
+// processes.
+template<typename T>
+class Seqlock
+{
+public:
+    void write(const T & value)
+    {
+        uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+        _sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(&_value, &value, sizeof(T));
+        _sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    T read() const
+    {
+        T value;
+        uint32_t before, after;
+        do
+        {
+            before = _sequence.load(std::memory_order_acquire);
+            memcpy(&value, &_value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = _sequence.load(std::memory_order_relaxed);
+        }
+        while((before & 1) || before != after);
+        return value;
+    }
+
+private:
+    std::atomic<uint32_t> _sequence;
+    T _value;
+};
@@ -195,6 +195,17 @@
 #include <wiringPi.h>
 #include <math.h>
 
+//
+// phases of homing, see setupHomeInSteps()
+//
+const int HOMING_IDLE = 0;
+const int HOMING_APPROACH = 1;
+const int HOMING_BACK_OFF = 2;
+const int HOMING_SLOW_APPROACH = 3;
+const int HOMING_SETTLING = 4;
+const int HOMING_STOPPING = 5;
+const unsigned long HOMING_SETTLE_MS = 25;
+
 // ---------------------------------------------------------------------------------
 //                                  Setup functions
 // ---------------------------------------------------------------------------------
@@ -215,6 +226,13 @@ SpeedyStepper::SpeedyStepper()
   desiredSpeed_InStepsPerSecond = DEFAULT_SPEED*STEPS_PER_MM;
   acceleration_InStepsPerSecondPerSecond = DEFAULT_ACCELERATION;
   currentStepPeriod_InUS = 0.0;
+  jerk_InStepsPerSecondPerSecondPerSecond = 0.0;
+  sCurve_Active = false;
+  sCurve_Stopping = false;
+  targetPosition_InSteps = 0;
+  renderMoveEnd_Pending = false;
+  homing_State = HOMING_IDLE;
+  homing_Succeeded = false;
 }
 
 
@@ -312,6 +330,22 @@ void SpeedyStepper::setAccelerationInMillimetersPerSecondPerSecond(
 
 
 
+//
+// set the jerk, units in millimeters/second/second/second.  Moves set up while the
+// jerk is not zero use a jerk limited S-curve profile instead of a trapezoid
+// Note: this can only be called when the motor is stopped
+//  Enter:  jerkInMillimetersPerSecondPerSecondPerSecond = rate of change of the
+//          acceleration, 0 for trapezoidal moves
+//
+void SpeedyStepper::setJerkInMillimetersPerSecondPerSecondPerSecond(
+                      float jerkInMillimetersPerSecondPerSecondPerSecond)
+{
+    jerk_InStepsPerSecondPerSecondPerSecond =
+      jerkInMillimetersPerSecondPerSecondPerSecond * stepsPerMillimeter;
+}
+
+
+
 //
 // home the motor by moving until the homing sensor is activated, then set the
 // position to zero, with units in millimeters
@@ -337,6 +371,22 @@ bool SpeedyStepper::moveToHomeInMillimeters(long directionTowardHome,
 
 
 
+//
+// setup homing without waiting for it, with units in millimeters.  See
+// setupHomeInSteps()
+//
+void SpeedyStepper::setupHomeInMillimeters(long directionTowardHome,
+  float speedInMillimetersPerSecond, long maxDistanceToMoveInMillimeters,
+  int homeLimitSwitchPin)
+{
+  setupHomeInSteps(directionTowardHome,
+                   speedInMillimetersPerSecond * stepsPerMillimeter,
+                   maxDistanceToMoveInMillimeters * stepsPerMillimeter,
+                   homeLimitSwitchPin);
+}
+
+
+
 //
 // move relative to the current position, units are in millimeters, this function
 // does not return until the move is complete
@@ -627,6 +677,12 @@ long SpeedyStepper::getCurrentPositionInSteps()
 //
 void SpeedyStepper::setupStop()
 {
+  if (sCurve_Active)
+  {
+    setupSCurveStop();
+    return;
+  }
+
   //
   // move the target position so that the motor will begin deceleration now
   //
@@ -665,6 +721,20 @@ void SpeedyStepper::setAccelerationInStepsPerSecondPerSecond(
 
 
 
+//
+// set the jerk, units in steps/second/second/second, 0 for trapezoidal moves
+// Note: this can only be called when the motor is stopped
+//  Enter:  jerkInStepsPerSecondPerSecondPerSecond = rate of change of the
+//          acceleration, units in steps/second/second/second
+//
+void SpeedyStepper::setJerkInStepsPerSecondPerSecondPerSecond(
+                      float jerkInStepsPerSecondPerSecondPerSecond)
+{
+    jerk_InStepsPerSecondPerSecondPerSecond = jerkInStepsPerSecondPerSecondPerSecond;
+}
+
+
+
 //
 // home the motor by moving until the homing sensor is activated, then set the
 // position to zero with units in steps
@@ -681,117 +751,215 @@ void SpeedyStepper::setAccelerationInStepsPerSecondPerSecond(
 bool SpeedyStepper::moveToHomeInSteps(long directionTowardHome,
   float speedInStepsPerSecond, long maxDistanceToMoveInSteps, int homeLimitSwitchPin)
 {
-  float originalDesiredSpeed_InStepsPerSecond;
-  bool limitSwitchFlag;
-  int SWITCH_MODE_OFF;
-  int SWITCH_MODE_ON;
+  setupHomeInSteps(directionTowardHome, speedInStepsPerSecond,
+    maxDistanceToMoveInSteps, homeLimitSwitchPin);
+
+  while(!processHoming())
+    ;
+
+  return(homing_Succeeded);
+}
+
 
+
+//
+// setup homing without waiting for it, units in steps.  Homing runs in three
+// phases: toward the switch until it closes, away from it until it opens, then
+// toward it again at 1/8 of the speed.  The motor settles for a moment after
+// each phase.  No motion occurs until processHoming() is called
+//  Enter:  directionTowardHome = 1 to move in a positive direction, -1 to move in
+//             a negative directions
+//          speedInStepsPerSecond = speed to accelerate up to while moving toward
+//             home, units in steps/second
+//          maxDistanceToMoveInSteps = unsigned maximum distance to move toward
+//             home before giving up
+//          homeSwitchPin = pin number of the home switch
+//
+void SpeedyStepper::setupHomeInSteps(long directionTowardHome,
+  float speedInStepsPerSecond, long maxDistanceToMoveInSteps, int homeLimitSwitchPin)
+{
   //
   // setup the home switch input pin
   //
   //pinMode(homeLimitSwitchPin, INPUT_PULLUP);
   pullUpDnControl(homeLimitSwitchPin, Z_STOP_PUD);
 
-
   //
-  // remember the current speed setting
+  // remember the current speed setting and the homing parameters
   //
-  originalDesiredSpeed_InStepsPerSecond = desiredSpeed_InStepsPerSecond;
+  homing_OriginalSpeed_InStepsPerSecond = desiredSpeed_InStepsPerSecond;
+  homing_Direction = directionTowardHome;
+  homing_Speed_InStepsPerSecond = speedInStepsPerSecond;
+  homing_MaxDistance_InSteps = maxDistanceToMoveInSteps;
+  homing_SwitchPin = homeLimitSwitchPin;
+  homing_Succeeded = false;
 
   // Evaluate active high or active low endstops
   if(Z_STOP_PUD == 1)
-  {
-    SWITCH_MODE_OFF = 0;
-    SWITCH_MODE_ON = 1;
-  } else {
-    SWITCH_MODE_OFF = 1;
-    SWITCH_MODE_ON = 0;
-  }
+    homing_SwitchOn = 1;
+  else
+    homing_SwitchOn = 0;
+
+  //
+  // if the home switch is already set, only move away from it and back
+  //
+  if (digitalRead(homeLimitSwitchPin) == homing_SwitchOn)
+    settleBeforeHomingPhase(HOMING_BACK_OFF);
+  else
+    startHomingPhase(HOMING_APPROACH);
+}
+
+
+
+//
+// if it is time, take the next step of homing.  This function must be called as
+// frequently as possible, like processMovement()
+//  Exit:   true returned when homing has finished, successful or not
+//
+bool SpeedyStepper::processHoming()
+{
+  bool moveComplete;
+  bool switchOn;
+
+  if (homing_State == HOMING_IDLE)
+    return(true);
 
   //
-  // if the home switch is not already set, move toward it
+  // wait while the motor settles, then start the next phase
   //
-  if (digitalRead(homeLimitSwitchPin) == SWITCH_MODE_OFF)
+  if (homing_State == HOMING_SETTLING)
   {
-    //
-    // move toward the home switch
-    //
-    setSpeedInStepsPerSecond(speedInStepsPerSecond);
-    setupRelativeMoveInSteps(maxDistanceToMoveInSteps * directionTowardHome);
-    limitSwitchFlag = false;
-    while(!processMovement())
+    if (millis() - homing_SettleStart_InMS < HOMING_SETTLE_MS)
+      return(false);
+
+    if (homing_NextState != HOMING_IDLE)
     {
-      if (digitalRead(homeLimitSwitchPin) == SWITCH_MODE_ON)
-      {
-        limitSwitchFlag = true;
-        break;
-      }
+      startHomingPhase(homing_NextState);
+      return(false);
     }
 
     //
-    // check if switch never detected
+    // successfully homed, set the current position to 0
     //
-    if (limitSwitchFlag == false)
-      return(false);
+    setCurrentPositionInSteps(0L);
+    finishHoming(true);
+    return(true);
   }
-  delay(25);
 
+  moveComplete = processMovement();
+  if (homing_State == HOMING_STOPPING)
+  {
+    if (!moveComplete)
+      return(false);
+
+    finishHoming(false);
+    return(true);
+  }
 
   //
-  // the switch has been detected, now move away from the switch
+  // each phase ends when the switch changes, the back off when it opens, the
+  // others when it closes
   //
-  setupRelativeMoveInSteps(maxDistanceToMoveInSteps * directionTowardHome * -1);
-  limitSwitchFlag = false;
-  while(!processMovement())
+  switchOn = (digitalRead(homing_SwitchPin) == homing_SwitchOn);
+  if (switchOn != (homing_State == HOMING_BACK_OFF))
   {
-    if (digitalRead(homeLimitSwitchPin) == SWITCH_MODE_OFF)
-    {
-      limitSwitchFlag = true;
-      break;
-    }
+    if (homing_State == HOMING_APPROACH)
+      settleBeforeHomingPhase(HOMING_BACK_OFF);
+    else if (homing_State == HOMING_BACK_OFF)
+      settleBeforeHomingPhase(HOMING_SLOW_APPROACH);
+    else
+      settleBeforeHomingPhase(HOMING_IDLE);
+    return(false);
   }
-  delay(25);
 
   //
   // check if switch never detected
   //
-  if (limitSwitchFlag == false)
-    return(false);
+  if (moveComplete)
+  {
+    finishHoming(false);
+    return(true);
+  }
 
+  return(false);
+}
 
-  //
-  // have now moved off the switch, move toward it again but slower
-  //
-  setSpeedInStepsPerSecond(speedInStepsPerSecond/8);
-  setupRelativeMoveInSteps(maxDistanceToMoveInSteps * directionTowardHome);
-  limitSwitchFlag = false;
-  while(!processMovement())
+
+
+//
+// stop homing, decelerating if the motor is moving.  processHoming() must still
+// be called until it returns true
+//
+void SpeedyStepper::abortHoming()
+{
+  if (homing_State == HOMING_IDLE || homing_State == HOMING_STOPPING)
+    return;
+
+  if (homing_State == HOMING_SETTLING)
   {
-    if (digitalRead(homeLimitSwitchPin) == SWITCH_MODE_ON)
-    {
-      limitSwitchFlag = true;
-      break;
-    }
+    finishHoming(false);
+    return;
   }
-  delay(25);
 
-  //
-  // check if switch never detected
-  //
-  if (limitSwitchFlag == false)
-    return(false);
+  setupStop();
+  homing_State = HOMING_STOPPING;
+}
 
 
-  //
-  // successfully homed, set the current position to 0
-  //
-  setCurrentPositionInSteps(0L);
 
-  //
-  // restore original velocity
-  //
-  setSpeedInStepsPerSecond(originalDesiredSpeed_InStepsPerSecond);
-  return(true);
+//
+// check if the last homing found the switch
+//  Exit:   true returned if it was successful, false while homing
+//
+bool SpeedyStepper::homingSucceeded()
+{
+  return(homing_Succeeded);
+}
+
+
+
+//
+// start moving for one phase of homing
+//
+void SpeedyStepper::startHomingPhase(int phase)
+{
+  long direction = homing_Direction;
+
+  if (phase == HOMING_SLOW_APPROACH)
+    setSpeedInStepsPerSecond(homing_Speed_InStepsPerSecond / 8);
+  else
+    setSpeedInStepsPerSecond(homing_Speed_InStepsPerSecond);
+
+  if (phase == HOMING_BACK_OFF)
+    direction = -direction;
+
+  setupRelativeMoveInSteps(homing_MaxDistance_InSteps * direction);
+  homing_State = phase;
+}
+
+
+
+//
+// pause after a phase of homing before starting the next one
+//  Enter:  nextPhase = phase to start after the pause, HOMING_IDLE when done
+//
+void SpeedyStepper::settleBeforeHomingPhase(int nextPhase)
+{
+  homing_SettleStart_InMS = millis();
+  homing_NextState = nextPhase;
+  homing_State = HOMING_SETTLING;
+}
+
+
+
+//
+// end homing and restore the original velocity
+//
+void SpeedyStepper::finishHoming(bool succeeded)
+{
+  setSpeedInStepsPerSecond(homing_OriginalSpeed_InStepsPerSecond);
+  homing_Succeeded = succeeded;
+  homing_State = HOMING_IDLE;
 }
 
 
@@ -849,6 +1017,23 @@ void SpeedyStepper::moveToPositionInSteps(long absolutePositionToMoveToInSteps)
 //          units of steps
 //
 void SpeedyStepper::setupMoveInSteps(long absolutePositionToMoveToInSteps)
+{
+  setupMoveInSteps(absolutePositionToMoveToInSteps, 0.0, 0.0);
+}
+
+
+
+//
+// setup a move that is part of a longer motion, so it does not have to start or
+// end at rest.  The planner must ensure the move is long enough to change between
+// the entry and exit speeds.  S-curve moves always start and end at rest
+//  Enter:  absolutePositionToMoveToInSteps = signed absolute position to move to in
+//            units of steps
+//          entrySpeedInStepsPerSecond = speed when the move starts
+//          exitSpeedInStepsPerSecond = speed to slow down to at the end of the move
+//
+void SpeedyStepper::setupMoveInSteps(long absolutePositionToMoveToInSteps,
+  float entrySpeedInStepsPerSecond, float exitSpeedInStepsPerSecond)
 {
   long distanceToTravel_InSteps;
 
@@ -872,13 +1057,6 @@ void SpeedyStepper::setupMoveInSteps(long absolutePositionToMoveToInSteps)
   desiredStepPeriod_InUS = 1000000.0 / desiredSpeed_InStepsPerSecond;
 
 
-  //
-  // determine the number of steps needed to go from the desired velocity down to a
-  // velocity of 0, Steps = Velocity^2 / (2 * Accelleration)
-  //
-  decelerationDistance_InSteps = (long) round((desiredSpeed_InStepsPerSecond *
-    desiredSpeed_InStepsPerSecond) / (2.0 * acceleration_InStepsPerSecondPerSecond));
-
 
   //
   // determine the distance and direction to travel
@@ -888,28 +1066,131 @@ void SpeedyStepper::setupMoveInSteps(long absolutePositionToMoveToInSteps)
   {
     distanceToTravel_InSteps = -distanceToTravel_InSteps;
     direction_Scaler = -1;
-    digitalWrite(directionPin, HIGH);
   }
   else
-  {
     direction_Scaler = 1;
-    digitalWrite(directionPin, LOW);
-  }
 
 
   //
-  // check if travel distance is too short to accelerate up to the desired velocity
+  // determine where to start decelerating
   //
-  if (distanceToTravel_InSteps <= (decelerationDistance_InSteps * 2L))
-    decelerationDistance_InSteps = (distanceToTravel_InSteps / 2L);
+  moveDistance_InSteps = distanceToTravel_InSteps;
+  entrySpeed_InStepsPerSecond = entrySpeedInStepsPerSecond;
+  exitSpeed_InStepsPerSecond = exitSpeedInStepsPerSecond;
+  decelerationStarted = false;
+  computeDecelerationDistance();
 
 
   //
-  // start the acceleration ramp at the beginning
+  // start the acceleration ramp at the beginning, or at the entry speed
   //
-  ramp_NextStepPeriod_InUS = ramp_InitialStepPeriod_InUS;
+  if (entrySpeedInStepsPerSecond > 0)
+    ramp_NextStepPeriod_InUS = 1000000.0 / entrySpeedInStepsPerSecond;
+  else
+    ramp_NextStepPeriod_InUS = ramp_InitialStepPeriod_InUS;
   acceleration_InStepsPerUSPerUS = acceleration_InStepsPerSecondPerSecond / 1E12;
+#if RAMP_FIXED_POINT
+  setupFixedPointRamp();
+#endif
+
+  //
+  // with a jerk set, the step times come from a precomputed S-curve instead
+  //
+  sCurve_Active = (jerk_InStepsPerSecondPerSecondPerSecond > 0) &&
+                  (distanceToTravel_InSteps > 0) &&
+                  (entrySpeedInStepsPerSecond == 0) && (exitSpeedInStepsPerSecond == 0);
+  if (sCurve_Active)
+    setupSCurve(distanceToTravel_InSteps);
+
   startNewMove = true;
+  renderMoveEnd_Pending = true;
+}
+
+
+
+//
+// change the speed the current move slows down to at its end.  This lets a planner
+// run through into a move queued after this one was set up
+//  Enter:  exitSpeedInStepsPerSecond = speed at the end of the move, not above the
+//            speed the move can reach
+//  Exit:   false returned if the deceleration has already started
+//
+bool SpeedyStepper::setExitSpeedInStepsPerSecond(float exitSpeedInStepsPerSecond)
+{
+  if (decelerationStarted || sCurve_Active)
+    return(false);
+
+  exitSpeed_InStepsPerSecond = exitSpeedInStepsPerSecond;
+  computeDecelerationDistance();
+  return(true);
+}
+
+
+
+//
+// get the speed the current move slows down to at its end
+//  Exit:  exit speed in steps/second returned
+//
+float SpeedyStepper::getExitSpeedInStepsPerSecond()
+{
+  return(exitSpeed_InStepsPerSecond);
+}
+
+
+
+//
+// get how long a move would take with the current speed, acceleration and jerk,
+// without stepping.  Trapezoidal moves use the closed-form ramp times, S-curve
+// moves their profile, which is set up for this.  So it must not be called while
+// a move is running
+//  Enter:  distanceToTravel_InSteps = unsigned distance of the move
+//          entrySpeedInStepsPerSecond = speed when the move starts
+//          exitSpeedInStepsPerSecond = speed at the end of the move
+//  Exit:   duration in seconds returned
+//
+double SpeedyStepper::getMoveTimeInSeconds(long distanceToTravel_InSteps,
+  float entrySpeedInStepsPerSecond, float exitSpeedInStepsPerSecond)
+{
+  double speed = desiredSpeed_InStepsPerSecond;
+  double acceleration = acceleration_InStepsPerSecondPerSecond;
+  double entrySpeed = entrySpeedInStepsPerSecond;
+  double exitSpeed = exitSpeedInStepsPerSecond;
+  double accelerationDistance;
+  double decelerationDistance;
+  double cruiseDistance;
+
+  if (distanceToTravel_InSteps <= 0)
+    return(0.0);
+
+  if ((jerk_InStepsPerSecondPerSecondPerSecond > 0) && (entrySpeed == 0) && (exitSpeed == 0))
+  {
+    setupSCurve(distanceToTravel_InSteps);
+    return(sCurve_EndTime);
+  }
+
+  //
+  // a move too short to reach the desired speed peaks where its ramps meet
+  //
+  accelerationDistance = (speed * speed - entrySpeed * entrySpeed) / (2.0 * acceleration);
+  decelerationDistance = (speed * speed - exitSpeed * exitSpeed) / (2.0 * acceleration);
+  if (accelerationDistance + decelerationDistance > distanceToTravel_InSteps)
+  {
+    speed = sqrt((2.0 * acceleration * distanceToTravel_InSteps +
+      entrySpeed * entrySpeed + exitSpeed * exitSpeed) / 2.0);
+    if (speed < entrySpeed)
+      speed = entrySpeed;
+    if (speed < exitSpeed)
+      speed = exitSpeed;
+    accelerationDistance = (speed * speed - entrySpeed * entrySpeed) / (2.0 * acceleration);
+    decelerationDistance = (speed * speed - exitSpeed * exitSpeed) / (2.0 * acceleration);
+  }
+
+  cruiseDistance = distanceToTravel_InSteps - accelerationDistance - decelerationDistance;
+  if (cruiseDistance < 0.0)
+    cruiseDistance = 0.0;
+
+  return((speed - entrySpeed) / acceleration + (speed - exitSpeed) / acceleration +
+    cruiseDistance / speed);
 }
 
 
@@ -934,8 +1215,12 @@ bool SpeedyStepper::processMovement(void)
   //
   // check if this is the first call to start this new move
   //
+  //
+  // the direction is only set here, rendered moves set it when they are played back
+  //
   if (startNewMove)
   {
+    digitalWrite(directionPin, (direction_Scaler < 0) != INVERT_DIR ? HIGH : LOW);
     ramp_LastStepTime_InUS = micros();
     startNewMove = false;
   }
@@ -950,7 +1235,7 @@ bool SpeedyStepper::processMovement(void)
   //
   // if it is not time for the next step, return
   //
-  if (periodSinceLastStep_InUS < (unsigned long) ramp_NextStepPeriod_InUS)
+  if (periodSinceLastStep_InUS < nextStepPeriodInUS())
     return(false);
 
   //
@@ -965,7 +1250,7 @@ bool SpeedyStepper::processMovement(void)
   // decelerating
   //
   if (distanceToTarget_InSteps == decelerationDistance_InSteps)
-    acceleration_InStepsPerUSPerUS = -acceleration_InStepsPerUSPerUS;
+    startDeceleration();
 
   //
   // execute the step on the rising edge
@@ -981,17 +1266,13 @@ bool SpeedyStepper::processMovement(void)
   // update the current position and speed
   //
   currentPosition_InSteps += direction_Scaler;
-  currentStepPeriod_InUS = ramp_NextStepPeriod_InUS;
+  currentStepPeriod_InUS = nextStepPeriodInUS();
 
 
   //
   // compute the period for the next step
-  // StepPeriodInUS = LastStepPeriodInUS *
-  //   (1 - AccelerationInStepsPerUSPerUS * LastStepPeriodInUS^2)
   //
-  ramp_NextStepPeriod_InUS = ramp_NextStepPeriod_InUS *
-    (1.0 - acceleration_InStepsPerUSPerUS * ramp_NextStepPeriod_InUS *
-    ramp_NextStepPeriod_InUS);
+  computeNextStepPeriod();
 
 
   //
@@ -1000,13 +1281,6 @@ bool SpeedyStepper::processMovement(void)
   digitalWrite(stepPin, LOW);
 
 
-  //
-  // clip the speed so that it does not accelerate beyond the desired velocity
-  //
-  if (ramp_NextStepPeriod_InUS < desiredStepPeriod_InUS)
-    ramp_NextStepPeriod_InUS = desiredStepPeriod_InUS;
-
-
   //
   // update the acceleration ramp
   //
@@ -1027,6 +1301,73 @@ bool SpeedyStepper::processMovement(void)
 
 
 
+//
+// render the steps of the move into a buffer as step intervals, instead of taking
+// them.  The same ramp as processMovement() is used, but the steps are computed
+// ahead of time so that the executor playing them back only has to wait and toggle
+// the pins.  Rendering stops once renderAhead_InUS worth of steps are buffered.
+// Note: the position returned by getCurrentPositionInSteps() is the rendered
+// position, which runs ahead of the motor
+//  Enter:  buffer = step buffer to append to
+//          renderAhead_InUS = how far ahead of the executor to render
+//          axes = if not NULL, the move is the lead axis of a coordinated move and
+//            the flags of each step come from axes, set up for the same distance
+//  Exit:   true returned once the whole move, including its MOVE_END marker, has
+//            been rendered
+//
+bool SpeedyStepper::renderMovement(StepBuffer &buffer, unsigned long renderAhead_InUS, CoordinatedAxes *axes)
+{
+  long distanceToTarget_InSteps;
+  StepEvent event;
+
+  event.flags = STEP_EVENT_STEP;
+  if (direction_Scaler < 0)
+    event.flags |= STEP_EVENT_DIRECTION;
+
+  while (currentPosition_InSteps != targetPosition_InSteps)
+  {
+    //
+    // stop once the buffer holds enough steps at the current rate
+    //
+    if (buffer.full() ||
+        buffer.size() * nextStepPeriodInUS() >= renderAhead_InUS)
+      return(false);
+
+    distanceToTarget_InSteps = targetPosition_InSteps - currentPosition_InSteps;
+    if (distanceToTarget_InSteps < 0)
+      distanceToTarget_InSteps = -distanceToTarget_InSteps;
+
+    if (distanceToTarget_InSteps == decelerationDistance_InSteps)
+      startDeceleration();
+
+    event.intervalInUS = nextStepPeriodInUS();
+    if (axes != NULL)
+      event.flags = axes->nextStepFlags();
+    buffer.push(event);
+
+    currentPosition_InSteps += direction_Scaler;
+    currentStepPeriod_InUS = event.intervalInUS;
+    computeNextStepPeriod();
+  }
+
+  //
+  // mark the end of the move so the executor can report its completion
+  //
+  if (renderMoveEnd_Pending)
+  {
+    event.intervalInUS = 0;
+    event.flags = STEP_EVENT_MOVE_END;
+    if (!buffer.push(event))
+      return(false);
+    renderMoveEnd_Pending = false;
+    currentStepPeriod_InUS = 0.0;
+  }
+
+  return(true);
+}
+
+
+
 //
 // Get the current velocity of the motor in steps/second.  This functions is updated
 // while it accelerates up and down in speed.  This is not the desired speed, but
@@ -1064,4 +1405,495 @@ bool SpeedyStepper::motionComplete()
     return(false);
 }
 
+// ---------------------------------------------------------------------------------
+//                                  Ramp functions
+// ---------------------------------------------------------------------------------
+
+#if RAMP_FIXED_POINT
+//
+// the fixed point ramp keeps the period in units of 2^-32 US.  The multiplies use
+// the period in units of 1/4096 US, so that periods up to one second fit in 32 bits
+//
+const int RAMP_FRACTION_BITS = 32;
+const int RAMP_MULTIPLY_SHIFT = 20;
+const uint64_t RAMP_MAX_PERIOD = (1ULL << (RAMP_FRACTION_BITS + 20)) - 1;
+
+static uint64_t toRampPeriod(float periodInUS)
+{
+  double period = ldexp((double) periodInUS, RAMP_FRACTION_BITS);
+  return(period < (double) RAMP_MAX_PERIOD ? (uint64_t) period : RAMP_MAX_PERIOD);
+}
+
+//
+// multiply a 64 bit value by a 32 bit value and shift the 96 bit product right,
+// using only 32x32 bit multiplies
+//  Enter:  shift = right shift of the product, at least 32
+//
+static uint64_t multiplyAndShift(uint64_t value, uint32_t multiplier, int shift)
+{
+  uint64_t high = (value >> 32) * multiplier;
+  uint64_t low = ((value & 0xffffffff) * multiplier) >> 32;
+  return((high + low) >> (shift - 32));
+}
+
+
+
+//
+// convert the ramp of a new move to fixed point.  The acceleration is kept as a
+// 32 bit mantissa so that small accelerations do not lose their precision
+//
+void SpeedyStepper::setupFixedPointRamp()
+{
+  double acceleration;
+  int shift;
+
+  rampFixed_NextStepPeriod = toRampPeriod(ramp_NextStepPeriod_InUS);
+  rampFixed_DesiredStepPeriod = toRampPeriod(desiredStepPeriod_InUS);
+  rampFixed_Decelerating = false;
+
+  //
+  // a * P^2 with the period squared in Q24 is returned in Q32 after shifting the
+  // product right by (mantissa bits - 8), which must be at least 32
+  //
+  acceleration = acceleration_InStepsPerSecondPerSecond / 1E12;
+  shift = 40;
+  while ((shift < 100) && (ldexp(acceleration, shift + 1) < 4294967295.0))
+    shift++;
+
+  if (ldexp(acceleration, shift) >= 4294967295.0)
+    rampFixed_Acceleration = 0xffffffff;
+  else
+    rampFixed_Acceleration = (uint32_t) ldexp(acceleration, shift);
+  rampFixed_ProductShift = shift - 8;
+}
+#endif
+
+
+
+//
+// determine the number of steps needed to go from the desired velocity down to the
+// exit velocity, Steps = (Velocity^2 - ExitVelocity^2) / (2 * Accelleration).  If
+// the move is too short to reach the desired velocity, the motor accelerates and
+// decelerates over the parts of the move that meet at the peak velocity
+//
+void SpeedyStepper::computeDecelerationDistance()
+{
+  float desiredSpeedSquared = desiredSpeed_InStepsPerSecond * desiredSpeed_InStepsPerSecond;
+  float entrySpeedSquared = entrySpeed_InStepsPerSecond * entrySpeed_InStepsPerSecond;
+  float exitSpeedSquared = exitSpeed_InStepsPerSecond * exitSpeed_InStepsPerSecond;
+  float accelerationDistance_InSteps;
+
+  decelerationDistance_InSteps = (long) round((desiredSpeedSquared - exitSpeedSquared) /
+    (2.0 * acceleration_InStepsPerSecondPerSecond));
+  accelerationDistance_InSteps = (desiredSpeedSquared - entrySpeedSquared) /
+    (2.0 * acceleration_InStepsPerSecondPerSecond);
+
+  //
+  // check if travel distance is too short to accelerate up to the desired velocity
+  //
+  if (moveDistance_InSteps <= decelerationDistance_InSteps + accelerationDistance_InSteps)
+    decelerationDistance_InSteps = (moveDistance_InSteps / 2L) + (long) round(
+      (entrySpeedSquared - exitSpeedSquared) / (4.0 * acceleration_InStepsPerSecondPerSecond));
+
+  if (decelerationDistance_InSteps < 0)
+    decelerationDistance_InSteps = 0;
+  if (decelerationDistance_InSteps > moveDistance_InSteps)
+    decelerationDistance_InSteps = moveDistance_InSteps;
+}
+
+
+
+//
+// get the period of the next step in US, rounded down
+//
+unsigned long SpeedyStepper::nextStepPeriodInUS()
+{
+  if (sCurve_Active)
+    return(sCurve_NextStepPeriod_InUS);
+
+#if RAMP_FIXED_POINT
+  return((unsigned long) (rampFixed_NextStepPeriod >> RAMP_FRACTION_BITS));
+#else
+  return((unsigned long) ramp_NextStepPeriod_InUS);
+#endif
+}
+
+
+
+//
+// change from accelerating to decelerating
+//
+void SpeedyStepper::startDeceleration()
+{
+  decelerationStarted = true;
+#if RAMP_FIXED_POINT
+  rampFixed_Decelerating = !rampFixed_Decelerating;
+#else
+  acceleration_InStepsPerUSPerUS = -acceleration_InStepsPerUSPerUS;
+#endif
+}
+
+
+
+//
+// compute the period for the next step
+// StepPeriodInUS = LastStepPeriodInUS *
+//   (1 - AccelerationInStepsPerUSPerUS * LastStepPeriodInUS^2)
+// and clip it so that it does not accelerate beyond the desired velocity
+//
+void SpeedyStepper::computeNextStepPeriod()
+{
+  if (sCurve_Active)
+  {
+    computeNextSCurveStepPeriod();
+    return;
+  }
+
+#if RAMP_FIXED_POINT
+  uint64_t period = rampFixed_NextStepPeriod;
+  uint64_t shortPeriod = period >> RAMP_MULTIPLY_SHIFT;
+  uint64_t accelerationTimesPeriodSquared;
+  uint64_t change;
+
+  //
+  // a * P^2 in Q32, from the period squared in Q24
+  //
+  accelerationTimesPeriodSquared = multiplyAndShift(shortPeriod * shortPeriod,
+    rampFixed_Acceleration, rampFixed_ProductShift);
+  if (accelerationTimesPeriodSquared > 0xffffffff)
+    accelerationTimesPeriodSquared = 0xffffffff;
+
+  change = (shortPeriod * accelerationTimesPeriodSquared) >> (32 - RAMP_MULTIPLY_SHIFT);
+  if (rampFixed_Decelerating)
+    period += change;
+  else
+    period -= change;
+
+  if (period > RAMP_MAX_PERIOD)
+    period = RAMP_MAX_PERIOD;
+  if (period < rampFixed_DesiredStepPeriod)
+    period = rampFixed_DesiredStepPeriod;
+  rampFixed_NextStepPeriod = period;
+#else
+  ramp_NextStepPeriod_InUS = ramp_NextStepPeriod_InUS *
+    (1.0 - acceleration_InStepsPerUSPerUS * ramp_NextStepPeriod_InUS *
+    ramp_NextStepPeriod_InUS);
+
+  if (ramp_NextStepPeriod_InUS < desiredStepPeriod_InUS)
+    ramp_NextStepPeriod_InUS = desiredStepPeriod_InUS;
+#endif
+}
+
+
+// ---------------------------------------------------------------------------------
+//                                S-curve functions
+// ---------------------------------------------------------------------------------
+
+//
+// An S-curve move ramps the acceleration up and down at the jerk rate, so its
+// velocity follows a smooth S from rest to the desired speed and back.  The
+// deceleration mirrors the acceleration, so only the acceleration phase is
+// described:
+//    0 .. T1        acceleration rises at the jerk rate to its peak
+//    T1 .. T1+T2    acceleration holds at the peak (skipped for short moves)
+//    T1+T2 .. Tacc  acceleration falls back to zero at the jerk rate
+// Step n is taken at the time the position reaches n steps.  That time is found
+// by inverting the position of the acceleration phase, the cruise is linear and
+// the deceleration uses the mirrored acceleration phase.
+//
+
+//
+// compute the shape of the acceleration phase for a given peak velocity
+//  Enter:  velocity = peak velocity in steps/second
+//  Exit:   distance of the acceleration phase in steps returned
+//
+double SpeedyStepper::setupSCurveAcceleration(double velocity)
+{
+  double jerk = jerk_InStepsPerSecondPerSecondPerSecond;
+  double acceleration = acceleration_InStepsPerSecondPerSecond;
+
+  if (velocity * jerk >= acceleration * acceleration)
+  {
+    sCurve_JerkTime = acceleration / jerk;
+    sCurve_PeakAccelerationTime = velocity / acceleration - sCurve_JerkTime;
+    sCurve_PeakAcceleration = acceleration;
+  }
+  else
+  {
+    //
+    // the velocity is reached before the acceleration can reach its peak
+    //
+    sCurve_JerkTime = sqrt(velocity / jerk);
+    sCurve_PeakAccelerationTime = 0.0;
+    sCurve_PeakAcceleration = jerk * sCurve_JerkTime;
+  }
+
+  sCurve_Velocity = velocity;
+  sCurve_AccelerationTime = 2.0 * sCurve_JerkTime + sCurve_PeakAccelerationTime;
+
+  //
+  // velocity and position at the end of the first two segments
+  //
+  sCurve_Velocity1 = jerk * sCurve_JerkTime * sCurve_JerkTime / 2.0;
+  sCurve_Position1 = jerk * sCurve_JerkTime * sCurve_JerkTime * sCurve_JerkTime / 6.0;
+  sCurve_Velocity2 = sCurve_Velocity1 + sCurve_PeakAcceleration * sCurve_PeakAccelerationTime;
+  sCurve_Position2 = sCurve_Position1 + sCurve_Velocity1 * sCurve_PeakAccelerationTime +
+    sCurve_PeakAcceleration * sCurve_PeakAccelerationTime * sCurve_PeakAccelerationTime / 2.0;
+
+  sCurve_AccelerationDistance = velocity * sCurve_AccelerationTime / 2.0;
+  return(sCurve_AccelerationDistance);
+}
+
+
+
+//
+// setup the S-curve profile of a new move
+//  Enter:  distanceToTravel_InSteps = unsigned distance of the move
+//
+void SpeedyStepper::setupSCurve(long distanceToTravel_InSteps)
+{
+  double accelerationDistance;
+  double low, high;
+  int i;
+
+  //
+  // if the move is too short to reach the desired velocity, search for the peak
+  // velocity that accelerates and decelerates over exactly its distance
+  //
+  accelerationDistance = setupSCurveAcceleration(desiredSpeed_InStepsPerSecond);
+  if (2.0 * accelerationDistance > distanceToTravel_InSteps)
+  {
+    low = 0.0;
+    high = desiredSpeed_InStepsPerSecond;
+    for (i = 0; i < 48; i++)
+    {
+      if (2.0 * setupSCurveAcceleration((low + high) / 2.0) > distanceToTravel_InSteps)
+        high = (low + high) / 2.0;
+      else
+        low = (low + high) / 2.0;
+    }
+    accelerationDistance = setupSCurveAcceleration(low);
+  }
+
+  //
+  // the deceleration starts where only the acceleration distance is left
+  //
+  sCurve_Stopping = false;
+  sCurve_Distance = distanceToTravel_InSteps;
+  sCurve_DecelerationStart = distanceToTravel_InSteps - accelerationDistance;
+  sCurve_EndTime = sCurveTimeAtStep(sCurve_DecelerationStart) +
+    sCurveAccelerationTime(accelerationDistance);
+
+  sCurve_StepCount = 0;
+  sCurve_LastStepTime_InUS = 0;
+  computeNextSCurveStepPeriod();
+}
+
+
+
+//
+// get the time into the acceleration phase at which it has covered a distance
+//  Enter:  distance = distance from the start of the move in steps
+//  Exit:   time in seconds returned
+//
+double SpeedyStepper::sCurveAccelerationTime(double distance)
+{
+  double jerk = jerk_InStepsPerSecondPerSecondPerSecond;
+  double acceleration = sCurve_PeakAcceleration;
+
+  if (distance <= 0.0)
+    return(0.0);
+
+  if (distance >= sCurve_AccelerationDistance)
+    return(sCurve_AccelerationTime);
+
+  //
+  // rising acceleration: position = jerk * t^3 / 6
+  //
+  if (distance <= sCurve_Position1)
+    return(cbrt(6.0 * distance / jerk));
+
+  //
+  // constant acceleration: solve the quadratic
+  //
+  if (distance <= sCurve_Position2)
+    return(sCurve_JerkTime + (sqrt(sCurve_Velocity1 * sCurve_Velocity1 + 2.0 *
+      acceleration * (distance - sCurve_Position1)) - sCurve_Velocity1) / acceleration);
+
+  //
+  // falling acceleration
+  //
+  return(sCurve_JerkTime + sCurve_PeakAccelerationTime +
+    sCurveFallingAccelerationTime(distance - sCurve_Position2, sCurve_Velocity2, acceleration));
+}
+
+
+
+//
+// get the time a segment whose acceleration falls to zero at the jerk rate takes
+// to cover a distance.  The position is convex in time there, so Newton's method
+// converges from the estimate at the starting velocity
+//  Enter:  distance = distance from the start of the segment in steps
+//          velocity = velocity at the start of the segment in steps/second
+//          acceleration = acceleration at the start of the segment
+//  Exit:   time in seconds returned
+//
+double SpeedyStepper::sCurveFallingAccelerationTime(double distance, double velocity,
+  double acceleration)
+{
+  double jerk = jerk_InStepsPerSecondPerSecondPerSecond;
+  double time, position, currentVelocity;
+  int i;
+
+  if (distance <= 0.0)
+    return(0.0);
+
+  time = distance / velocity;
+  if (time > acceleration / jerk)
+    time = acceleration / jerk;
+  for (i = 0; i < 4; i++)
+  {
+    position = velocity * time + acceleration * time * time / 2.0 - jerk * time * time * time / 6.0;
+    currentVelocity = velocity + acceleration * time - jerk * time * time / 2.0;
+    time -= (position - distance) / currentVelocity;
+  }
+
+  return(time);
+}
+
+
+
+//
+// get the velocity and acceleration during the acceleration phase or the cruise
+//  Enter:  time = time into the move in seconds
+//          velocity = set to the velocity in steps/second
+//          acceleration = set to the acceleration in steps/second/second
+//
+void SpeedyStepper::sCurveAccelerationState(double time, double &velocity, double &acceleration)
+{
+  double jerk = jerk_InStepsPerSecondPerSecondPerSecond;
+
+  if (time >= sCurve_AccelerationTime)
+  {
+    velocity = sCurve_Velocity;
+    acceleration = 0.0;
+  }
+  else if (time <= sCurve_JerkTime)
+  {
+    velocity = jerk * time * time / 2.0;
+    acceleration = jerk * time;
+  }
+  else if (time <= sCurve_JerkTime + sCurve_PeakAccelerationTime)
+  {
+    velocity = sCurve_Velocity1 + sCurve_PeakAcceleration * (time - sCurve_JerkTime);
+    acceleration = sCurve_PeakAcceleration;
+  }
+  else
+  {
+    time -= sCurve_JerkTime + sCurve_PeakAccelerationTime;
+    velocity = sCurve_Velocity2 + sCurve_PeakAcceleration * time - jerk * time * time / 2.0;
+    acceleration = sCurve_PeakAcceleration - jerk * time;
+  }
+
+  if (acceleration < 0.0)
+    acceleration = 0.0;
+}
+
+
+
+//
+// get the time into the move at which a step is taken
+//  Enter:  step = number of steps from the start of the move
+//  Exit:   time in seconds returned
+//
+double SpeedyStepper::sCurveTimeAtStep(double step)
+{
+  if (step > sCurve_DecelerationStart)
+    return(sCurve_EndTime - sCurveAccelerationTime(sCurve_Distance - step));
+
+  //
+  // after a stop the acceleration falls to zero, then the move cruises for the
+  // fraction of a step that brings the deceleration to a whole step
+  //
+  if (sCurve_Stopping)
+  {
+    if (step <= sCurve_StopStep + sCurve_StopRampDistance)
+      return(sCurve_StopTime + sCurveFallingAccelerationTime(step - sCurve_StopStep,
+        sCurve_StopVelocity, sCurve_StopAcceleration));
+
+    return(sCurve_StopTime + sCurve_StopRampTime +
+      (step - sCurve_StopStep - sCurve_StopRampDistance) / sCurve_Velocity);
+  }
+
+  if (step <= sCurve_AccelerationDistance)
+    return(sCurveAccelerationTime(step));
+
+  return(sCurve_AccelerationTime + (step - sCurve_AccelerationDistance) / sCurve_Velocity);
+}
+
+
+
+//
+// compute the period before the next step of an S-curve move.  Periods are the
+// differences of the rounded down step times, so they do not add up rounding
+// errors over a long move
+//
+void SpeedyStepper::computeNextSCurveStepPeriod()
+{
+  unsigned long nextStepTime_InUS;
+
+  sCurve_StepCount++;
+  nextStepTime_InUS = (unsigned long) (sCurveTimeAtStep(sCurve_StepCount) * 1E6);
+  sCurve_NextStepPeriod_InUS = nextStepTime_InUS - sCurve_LastStepTime_InUS;
+  sCurve_LastStepTime_InUS = nextStepTime_InUS;
+}
+
+
+
+//
+// setup a stop of an S-curve move.  If it is still accelerating, the acceleration
+// first falls to zero at the jerk rate, so it never switches straight from
+// accelerating to decelerating.  The deceleration is then the mirror image of an
+// acceleration phase to the velocity reached
+//
+void SpeedyStepper::setupSCurveStop()
+{
+  double jerk = jerk_InStepsPerSecondPerSecondPerSecond;
+  double step = sCurve_StepCount - 1;
+  double time, velocity, acceleration;
+  double decelerationDistance;
+
+  if (sCurve_Stopping || step >= sCurve_DecelerationStart)
+    return;
+
+  time = sCurveTimeAtStep(step);
+  sCurveAccelerationState(time, velocity, acceleration);
+
+  sCurve_Stopping = true;
+  sCurve_StopStep = step;
+  sCurve_StopTime = time;
+  sCurve_StopVelocity = velocity;
+  sCurve_StopAcceleration = acceleration;
+  sCurve_StopRampTime = acceleration / jerk;
+  sCurve_StopRampDistance = velocity * sCurve_StopRampTime +
+    acceleration * sCurve_StopRampTime * sCurve_StopRampTime / 2.0 -
+    jerk * sCurve_StopRampTime * sCurve_StopRampTime * sCurve_StopRampTime / 6.0;
+
+  //
+  // the move ends on a whole step, the deceleration is shifted there
+  //
+  decelerationDistance = setupSCurveAcceleration(velocity + acceleration * sCurve_StopRampTime / 2.0);
+  sCurve_Distance = (long) ceil(step + sCurve_StopRampDistance + decelerationDistance);
+  sCurve_DecelerationStart = sCurve_Distance - decelerationDistance;
+  sCurve_EndTime = sCurveTimeAtStep(sCurve_DecelerationStart) + sCurve_AccelerationTime;
+  targetPosition_InSteps = currentPosition_InSteps + direction_Scaler *
+    (sCurve_Distance - (long) step);
+
+  //
+  // the next step was timed on the old profile
+  //
+  sCurve_StepCount--;
+  computeNextSCurveStepPeriod();
+}
+
 // -------------------------------------- End --------------------------------------
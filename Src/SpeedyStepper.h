@@ -37,6 +37,9 @@
 //#include <arduino.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include "StepBuffer.h"
+#include "CoordinatedAxes.h"
+#include "Config.h"
 typedef uint8_t byte;
 
 //
@@ -56,7 +59,9 @@ class SpeedyStepper
     void setCurrentPositionInMillimeters(float currentPositionInMillimeter);
     void setSpeedInMillimetersPerSecond(float speedInMillimetersPerSecond);
     void setAccelerationInMillimetersPerSecondPerSecond(float accelerationInMillimetersPerSecondPerSecond);
+    void setJerkInMillimetersPerSecondPerSecondPerSecond(float jerkInMillimetersPerSecondPerSecondPerSecond);
     bool moveToHomeInMillimeters(long directionTowardHome, float speedInMillimetersPerSecond, long maxDistanceToMoveInMillimeters, int homeLimitSwitchPin);
+    void setupHomeInMillimeters(long directionTowardHome, float speedInMillimetersPerSecond, long maxDistanceToMoveInMillimeters, int homeLimitSwitchPin);
     void moveRelativeInMillimeters(float distanceToMoveInMillimeters);
     void setupRelativeMoveInMillimeters(float distanceToMoveInMillimeters);
     void moveToPositionInMillimeters(float absolutePositionToMoveToInMillimeters);
@@ -83,17 +88,49 @@ class SpeedyStepper
     void setupStop();
     void setSpeedInStepsPerSecond(float speedInStepsPerSecond);
     void setAccelerationInStepsPerSecondPerSecond(float accelerationInStepsPerSecondPerSecond);
+    void setJerkInStepsPerSecondPerSecondPerSecond(float jerkInStepsPerSecondPerSecondPerSecond);
     bool moveToHomeInSteps(long directionTowardHome, float speedInStepsPerSecond, long maxDistanceToMoveInSteps, int homeSwitchPin);
+    void setupHomeInSteps(long directionTowardHome, float speedInStepsPerSecond, long maxDistanceToMoveInSteps, int homeLimitSwitchPin);
+    bool processHoming();
+    void abortHoming();
+    bool homingSucceeded();
     void moveRelativeInSteps(long distanceToMoveInSteps);
     void setupRelativeMoveInSteps(long distanceToMoveInSteps);
     void moveToPositionInSteps(long absolutePositionToMoveToInSteps);
     void setupMoveInSteps(long absolutePositionToMoveToInSteps);
+    void setupMoveInSteps(long absolutePositionToMoveToInSteps, float entrySpeedInStepsPerSecond, float exitSpeedInStepsPerSecond);
+    bool setExitSpeedInStepsPerSecond(float exitSpeedInStepsPerSecond);
+    float getExitSpeedInStepsPerSecond();
+    double getMoveTimeInSeconds(long distanceToTravel_InSteps, float entrySpeedInStepsPerSecond, float exitSpeedInStepsPerSecond);
     bool motionComplete();
     float getCurrentVelocityInStepsPerSecond(); 
     bool processMovement(void);
+    bool renderMovement(StepBuffer &buffer, unsigned long renderAhead_InUS, CoordinatedAxes *axes = NULL);
 
 
   private:
+    //
+    // private functions
+    //
+    void computeDecelerationDistance();
+    unsigned long nextStepPeriodInUS();
+    void startDeceleration();
+    void computeNextStepPeriod();
+#if RAMP_FIXED_POINT
+    void setupFixedPointRamp();
+#endif
+    double setupSCurveAcceleration(double velocity);
+    void setupSCurve(long distanceToTravel_InSteps);
+    double sCurveAccelerationTime(double distance);
+    double sCurveFallingAccelerationTime(double distance, double velocity, double acceleration);
+    void sCurveAccelerationState(double time, double &velocity, double &acceleration);
+    double sCurveTimeAtStep(double step);
+    void computeNextSCurveStepPeriod();
+    void setupSCurveStop();
+    void startHomingPhase(int phase);
+    void settleBeforeHomingPhase(int nextPhase);
+    void finishHoming(bool succeeded);
+
     //
     // private member variables
     //
@@ -114,6 +151,53 @@ class SpeedyStepper
     float acceleration_InStepsPerUSPerUS;
     float currentStepPeriod_InUS;
     long currentPosition_InSteps;
+    bool renderMoveEnd_Pending;
+    long moveDistance_InSteps;
+    float entrySpeed_InStepsPerSecond;
+    float exitSpeed_InStepsPerSecond;
+    bool decelerationStarted;
+    float jerk_InStepsPerSecondPerSecondPerSecond;
+    bool sCurve_Active;
+    double sCurve_Velocity;
+    double sCurve_PeakAcceleration;
+    double sCurve_JerkTime;
+    double sCurve_PeakAccelerationTime;
+    double sCurve_AccelerationTime;
+    double sCurve_AccelerationDistance;
+    double sCurve_Velocity1;
+    double sCurve_Position1;
+    double sCurve_Velocity2;
+    double sCurve_Position2;
+    double sCurve_DecelerationStart;
+    double sCurve_EndTime;
+    long sCurve_Distance;
+    bool sCurve_Stopping;
+    double sCurve_StopStep;
+    double sCurve_StopTime;
+    double sCurve_StopVelocity;
+    double sCurve_StopAcceleration;
+    double sCurve_StopRampTime;
+    double sCurve_StopRampDistance;
+    long sCurve_StepCount;
+    unsigned long sCurve_LastStepTime_InUS;
+    unsigned long sCurve_NextStepPeriod_InUS;
+    int homing_State;
+    int homing_NextState;
+    long homing_Direction;
+    float homing_Speed_InStepsPerSecond;
+    long homing_MaxDistance_InSteps;
+    int homing_SwitchPin;
+    int homing_SwitchOn;
+    unsigned long homing_SettleStart_InMS;
+    float homing_OriginalSpeed_InStepsPerSecond;
+    bool homing_Succeeded;
+#if RAMP_FIXED_POINT
+    uint64_t rampFixed_NextStepPeriod;
+    uint64_t rampFixed_DesiredStepPeriod;
+    uint32_t rampFixed_Acceleration;
+    int rampFixed_ProductShift;
+    bool rampFixed_Decelerating;
+#endif
 };
 
 // ------------------------------------ End ---------------------------------
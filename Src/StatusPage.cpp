@@ -0,0 +1,56 @@
+#include "StatusPage.h"
+#include "Config.h"
+
+#include <wiringPi.h>
+#include <new>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+
+StatusPage privatePage;
+StatusPage * page = &privatePage;
+
+}
+
+bool openStatusPage()
+{
+    int fd = shm_open(STATUS_PAGE_NAME, O_CREAT | O_RDWR, 0644);
+    if(fd < 0)
+        return false;
+
+    void * mapped = MAP_FAILED;
+    if(ftruncate(fd, sizeof(StatusPage)) == 0)
+        mapped = mmap(NULL, sizeof(StatusPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        return false;
+
+    // Left over from an earlier run, the sequences restart from 0
+    page = new(mapped) StatusPage();
+    page->magic = STATUS_PAGE_MAGIC;
+    page->version = STATUS_PAGE_VERSION;
+    return true;
+}
+
+StatusPage & statusPage()
+{
+    return *page;
+}
+
+void publishMotionStatus(const StepExecutor & executor)
+{
+    MotionStatus status = {};
+    status.time_InUS = micros();
+    status.positionInSteps = executor.getPositionInSteps();
+    status.positionInMillimeters = status.positionInSteps / (float)STEPS_PER_MM;
+    status.velocityInMillimetersPerSecond = executor.getVelocityInStepsPerSecond() / STEPS_PER_MM;
+    status.completedMoves = executor.getCompletedMoves();
+    status.droppedSteps = executor.getDroppedSteps();
+    status.held = executor.isHeld();
+    for(int axis = 1; axis < STEP_EVENT_AXES; axis++)
+        status.axisPositionsInSteps[axis - 1] = executor.getPositionInSteps(axis);
+    page->motion.write(status);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Seqlock.h"
+#include "StepExecutor.h"
+
+#include <stdint.h>
+
+// Machine state published in shared memory, so local dashboards can follow it
+// without a command and, once the page is mapped, without a syscall. Map
+// /dev/shm/NanoDLPShield.status read only and read each block through its
+// seqlock. New fields are only ever added at the end of a block, with a new
+// version.
+const char * const STATUS_PAGE_NAME = "/NanoDLPShield.status";
+const uint32_t STATUS_PAGE_MAGIC = 0x504c444e;     // "NDLP"
+const uint32_t STATUS_PAGE_VERSION = 2;
+
+// Written by whoever takes the steps, the motion thread or the main loop
+struct MotionStatus
+{
+    uint32_t time_InUS;                     // micros() when written
+    int32_t positionInSteps;
+    float positionInMillimeters;
+    float velocityInMillimetersPerSecond;   // negative downward, 0 at rest
+    uint32_t completedMoves;
+    uint32_t droppedSteps;                  // at a closed endstop
+    uint8_t held;                           // stopped by M25 or M112
+    uint8_t reserved[3];
+    int32_t axisPositionsInSteps[STEP_EVENT_AXES - 1];     // auxiliary axes, from version 2
+};
+
+// Written by the main loop
+struct MachineStatus
+{
+    uint32_t time_InUS;
+    float targetInMillimeters;              // end of the last planned move
+    float temperatureInCelsius;             // NAN without a thermometer
+    uint16_t fanPwm;                        // 0-1023
+    uint8_t uvLedOn;
+    uint8_t motorEnabled;
+    uint8_t executionState;                 // idle, moving, dwelling, homing
+    uint8_t feedHold;
+    uint8_t emergencyStop;
+    uint8_t jobRunning;
+    uint32_t queuedCommands;
+};
+
+struct StatusPage
+{
+    uint32_t magic;
+    uint32_t version;
+    Seqlock<MotionStatus> motion;
+    Seqlock<MachineStatus> machine;
+};
+
+// Maps the page, false if it cannot be shared. The status is then kept in
+// private memory, so statusPage() can always be used.
+bool openStatusPage();
+StatusPage & statusPage();
+
+// Snapshot of the executor into the motion block, only from the thread that
+// runs it
+void publishMotionStatus(const StepExecutor & executor);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// One entry of a rendered move: wait intervalInUS after the previous step,
+// then set the directions and pulse the step pins. Each axis has one step and
+// one direction bit, Z is axis 0. A MOVE_END entry carries no step and marks
+// the point where a move has been completely executed.
+struct StepEvent
+{
+    uint32_t intervalInUS;
+    uint32_t flags;
+};
+
+const int STEP_EVENT_AXES = 3;
+const uint32_t STEP_EVENT_STEP = 1u << 0;          // axis n steps with STEP << n
+const uint32_t STEP_EVENT_DIRECTION = 1u << 8;     // set for negative moves, DIRECTION << n
+const uint32_t STEP_EVENT_STEPS = ((1u << STEP_EVENT_AXES) - 1) * STEP_EVENT_STEP;
+const uint32_t STEP_EVENT_DIRECTIONS = ((1u << STEP_EVENT_AXES) - 1) * STEP_EVENT_DIRECTION;
+const uint32_t STEP_EVENT_MOVE_END = 1u << 31;
+
+// Lock-free single-producer/single-consumer ring between the planner, which
+// renders step intervals ahead of time, and the step executor.
+class StepBuffer
+{
+public:
+    static const size_t CAPACITY = 1024;    // must be a power of two
+
+    StepBuffer()
+        : _head(0)
+        , _tail(0)
+    {}
+
+    // Producer side
+    bool full() const { return _tail.load(std::memory_order_relaxed) - _head.load(std::memory_order_acquire) == CAPACITY; }
+
+    bool push(const StepEvent & event)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if(tail - _head.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+
+        _events[tail & (CAPACITY - 1)] = event;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    const StepEvent * front() const
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if(head == _tail.load(std::memory_order_acquire))
+            return NULL;
+        return &_events[head & (CAPACITY - 1)];
+    }
+
+    void pop() { _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Either side
+    size_t size() const { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+    bool empty() const { return size() == 0; }
+
+private:
+    StepEvent _events[CAPACITY];
+    std::atomic<size_t> _head;
+    std::atomic<size_t> _tail;
+};
@@ -0,0 +1,273 @@
+#include "StepExecutor.h"
+#include "Config.h"
+
+#include <wiringPi.h>
+#include <math.h>
+#include <stdlib.h>
+
+template<typename Pins>
+BasicStepExecutor<Pins>::BasicStepExecutor(StepBuffer & buffer, Gpio & gpio)
+    : _buffer(buffer)
+    , _gpio(gpio)
+    , _running(false)
+    , _directions(0)
+    , _directionValid(false)
+    , _lastStepTime_InUS(0)
+    , _completedMoves(0)
+    , _stepPeriod_InUS(0)
+    , _blocked(0)
+    , _droppedSteps(0)
+    , _holdState(HOLD_NONE)
+    , _holdSpeed(0)
+    , _holdAcceleration(0)
+    , _holdRequested(false)
+    , _held(false)
+    , _flushRequested(false)
+{
+    for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        _positions[axis].store(0, std::memory_order_relaxed);
+}
+
+template<typename Pins>
+void BasicStepExecutor<Pins>::connectToPins(int stepPinNumber, int directionPinNumber)
+{
+    connectAxis(0, stepPinNumber, directionPinNumber, INVERT_DIR);
+}
+
+template<typename Pins>
+void BasicStepExecutor<Pins>::connectAxis(int axis, int stepPinNumber, int directionPinNumber, bool invertDirection)
+{
+    _pins.connect(axis, stepPinNumber, directionPinNumber, invertDirection);
+}
+
+template<typename Pins>
+bool BasicStepExecutor<Pins>::process()
+{
+    if(!serviceHold())
+        return true;
+
+    const StepEvent * event = dropBlockedSteps();
+    if(event == NULL)
+    {
+        // A hold with nothing left to slow down is complete, a resume too
+        if(_holdState == HOLD_STOPPING)
+            _holdState = HOLD_HELD;
+        else if(_holdState == HOLD_RESUMING)
+            _holdState = HOLD_NONE;
+
+        // Others may drive the pins while we are idle
+        _running = false;
+        _directionValid = false;
+        _stepPeriod_InUS.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    // A move that starts from rest is timed from the moment it is first seen
+    unsigned long currentTime_InUS = micros();
+    if(!_running)
+    {
+        _lastStepTime_InUS = currentTime_InUS;
+        _running = true;
+    }
+
+    if(event->flags & STEP_EVENT_MOVE_END)
+    {
+        _buffer.pop();
+        _completedMoves.fetch_add(1, std::memory_order_release);
+        return _buffer.empty();
+    }
+
+    unsigned long interval_InUS = intervalOf(*event);
+    if(currentTime_InUS - _lastStepTime_InUS < interval_InUS)
+        return false;
+
+    uint32_t directions = event->flags & STEP_EVENT_DIRECTIONS;
+    if(directions != _directions || !_directionValid)
+    {
+        uint32_t setMask, clearMask;
+        _pins.directionMasks(directions, setMask, clearMask);
+        _gpio.write(setMask, clearMask);
+        _directions = directions;
+        _directionValid = true;
+        delayMicroseconds(2);
+    }
+
+    uint32_t steps = event->flags & STEP_EVENT_STEPS;
+    uint32_t stepMask = _pins.stepMask(steps);
+
+    // The bookkeeping is done while the step pins are high, which keeps the
+    // pulse wide enough for most drivers without waiting
+    bool negative = directions & STEP_EVENT_DIRECTION;
+    if(steps)
+    {
+        _gpio.write(stepMask, 0);
+        for(int axis = 0; axis < Pins::AXES; axis++)
+        {
+            if(steps & (STEP_EVENT_STEP << axis))
+                _positions[axis].fetch_add((directions & (STEP_EVENT_DIRECTION << axis)) ? -1 : 1, std::memory_order_relaxed);
+        }
+    }
+
+    _stepPeriod_InUS.store(negative ? -(int32_t)interval_InUS : interval_InUS, std::memory_order_relaxed);
+    _lastStepTime_InUS = currentTime_InUS;
+    if(_holdState != HOLD_NONE)
+        updateHoldSpeed(interval_InUS, event->intervalInUS);
+    _buffer.pop();
+
+    if(steps)
+    {
+        if(STEP_PULSE_US > 0)
+            delayMicroseconds(STEP_PULSE_US);
+        _gpio.write(0, stepMask);
+    }
+    return false;
+}
+
+template<typename Pins>
+void BasicStepExecutor<Pins>::setBlocked(uint32_t direction, bool blocked)
+{
+    if(blocked)
+        _blocked.fetch_or(direction, std::memory_order_relaxed);
+    else
+        _blocked.fetch_and(~direction, std::memory_order_relaxed);
+}
+
+template<typename Pins>
+void BasicStepExecutor<Pins>::hold(float deceleration)
+{
+    _holdAcceleration.store(deceleration, std::memory_order_relaxed);
+    _holdRequested.store(true, std::memory_order_release);
+}
+
+template<typename Pins>
+void BasicStepExecutor<Pins>::resume()
+{
+    _holdRequested.store(false, std::memory_order_release);
+}
+
+template<typename Pins>
+bool BasicStepExecutor<Pins>::serviceHold() // Follows hold and resume requests, false while held
+{
+    bool holdRequested = _holdRequested.load(std::memory_order_acquire);
+    float minSpeed = sqrtf(2 * _holdAcceleration.load(std::memory_order_relaxed));
+
+    if(holdRequested && (_holdState == HOLD_NONE || _holdState == HOLD_RESUMING))
+    {
+        // Slow down from the speed of the last step, at once if there was none
+        if(_holdState == HOLD_NONE)
+        {
+            int32_t period = abs(_stepPeriod_InUS.load(std::memory_order_relaxed));
+            _holdSpeed = period > 0 ? 1000000.0f / period : 0;
+        }
+        _holdState = _holdSpeed > minSpeed ? HOLD_STOPPING : HOLD_HELD;
+    }
+    else if(!holdRequested && (_holdState == HOLD_STOPPING || _holdState == HOLD_HELD))
+    {
+        if(_holdSpeed < minSpeed)
+            _holdSpeed = minSpeed;
+        _holdState = HOLD_RESUMING;
+    }
+
+    if(_holdState != HOLD_HELD)
+    {
+        _held.store(false, std::memory_order_release);
+        return true;
+    }
+
+    if(_flushRequested.load(std::memory_order_acquire))
+    {
+        for(const StepEvent * event = _buffer.front(); event != NULL; event = _buffer.front())
+        {
+            if(event->flags & STEP_EVENT_MOVE_END)
+                _completedMoves.fetch_add(1, std::memory_order_release);
+            _buffer.pop();
+        }
+        _flushRequested.store(false, std::memory_order_release);
+    }
+
+    _running = false;
+    _stepPeriod_InUS.store(0, std::memory_order_relaxed);
+    _held.store(true, std::memory_order_release);
+    return false;
+}
+
+template<typename Pins>
+unsigned long BasicStepExecutor<Pins>::intervalOf(const StepEvent & event) const // Stretched while stopping for a hold or resuming
+{
+    if(_holdState == HOLD_NONE)
+        return event.intervalInUS;
+
+    unsigned long held_InUS = (unsigned long)(1000000.0f / _holdSpeed);
+    return held_InUS > event.intervalInUS ? held_InUS : event.intervalInUS;
+}
+
+template<typename Pins>
+void BasicStepExecutor<Pins>::updateHoldSpeed(unsigned long interval_InUS, unsigned long rendered_InUS) // After each step while stopping or resuming
+{
+    float acceleration = _holdAcceleration.load(std::memory_order_relaxed);
+    float speed = 1000000.0f / interval_InUS;
+
+    if(_holdState == HOLD_STOPPING)
+    {
+        speed -= acceleration / speed;
+        if(speed <= sqrtf(2 * acceleration))
+            _holdState = HOLD_HELD;
+        else
+            _holdSpeed = speed;
+    }
+    else
+    {
+        speed += acceleration / speed;
+        if(rendered_InUS == 0 || speed >= 1000000.0f / rendered_InUS)
+            _holdState = HOLD_NONE;
+        else
+            _holdSpeed = speed;
+    }
+}
+
+template<typename Pins>
+const StepEvent * BasicStepExecutor<Pins>::dropBlockedSteps() // Returns the front event once no blocked step is in front
+{
+    const StepEvent * event = _buffer.front();
+    uint32_t blocked = _blocked.load(std::memory_order_relaxed);
+    if(blocked == 0)
+        return event;
+
+    while(event != NULL && (event->flags & STEP_EVENT_STEP))
+    {
+        uint32_t direction = (event->flags & STEP_EVENT_DIRECTION) ? BLOCK_NEGATIVE : BLOCK_POSITIVE;
+        if(!(blocked & direction))
+            break;
+
+        _buffer.pop();
+        _droppedSteps.fetch_add(1, std::memory_order_relaxed);
+        event = _buffer.front();
+    }
+    return event;
+}
+
+template<typename Pins>
+unsigned long BasicStepExecutor<Pins>::getWaitInUS() const
+{
+    const StepEvent * event = _buffer.front();
+    if(event == NULL || !_running)
+        return 0;
+
+    unsigned long interval_InUS = intervalOf(*event);
+    unsigned long elapsedUS = micros() - _lastStepTime_InUS;
+    return elapsedUS < interval_InUS ? interval_InUS - elapsedUS : 0;
+}
+
+template<typename Pins>
+float BasicStepExecutor<Pins>::getVelocityInStepsPerSecond() const
+{
+    int32_t period = _stepPeriod_InUS.load(std::memory_order_relaxed);
+    if(period == 0)
+        return 0;
+    return 1000000.0 / period;
+}
+
+template class BasicStepExecutor<RuntimeStepPins>;
+#if FIXED_STEP_PINS
+template class BasicStepExecutor<ConfigStepPins>;
+#endif
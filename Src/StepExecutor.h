@@ -0,0 +1,108 @@
+#pragma once
+
+#include "StepBuffer.h"
+#include "StepPins.h"
+#include "Gpio.h"
+#include "Config.h"
+
+#include <stdint.h>
+#include <atomic>
+
+// Plays back step intervals rendered by the planner. All ramp math happens
+// ahead of time, so the executor only waits for the next step time and
+// toggles the step and direction pins. The axes stepped by one event are
+// pulsed together. Pins is RuntimeStepPins or a FixedStepPins, see StepPins.h.
+template<typename Pins>
+class BasicStepExecutor
+{
+public:
+    BasicStepExecutor(StepBuffer & buffer, Gpio & gpio);
+
+    // Z, axis 0
+    void connectToPins(int stepPinNumber, int directionPinNumber);
+    void connectAxis(int axis, int stepPinNumber, int directionPinNumber, bool invertDirection);
+
+    // Takes the next step if it is due.
+    // Returns true if the buffer has run empty.
+    bool process();
+
+    // Time left until the next step is due, 0 if it is due or nothing is buffered
+    unsigned long getWaitInUS() const;
+
+    long getPositionInSteps(int axis = 0) const { return _positions[axis].load(std::memory_order_relaxed); }
+    void setPositionInSteps(long position, int axis = 0) { _positions[axis].store(position, std::memory_order_relaxed); }
+
+    // Number of MOVE_END markers passed so far
+    uint32_t getCompletedMoves() const { return _completedMoves.load(std::memory_order_acquire); }
+
+    // Signed speed of the last step, zero while idle. In a coordinated move
+    // that is the lead axis, signed by the direction of Z.
+    float getVelocityInStepsPerSecond() const;
+
+    // Steps in a blocked direction are dropped as soon as they come up, so a
+    // move toward a closed endstop ends at once. Safe to call from any thread.
+    static const uint32_t BLOCK_POSITIVE = 1;
+    static const uint32_t BLOCK_NEGATIVE = 2;
+    void setBlocked(uint32_t direction, bool blocked);
+    uint32_t getDroppedSteps() const { return _droppedSteps.load(std::memory_order_relaxed); }
+
+    // Feed hold: the steps are stretched until the motor is down to the speed
+    // of a first step from rest, then no more are taken until resume(), which
+    // ramps back up to the rendered speeds. The motor follows the rendered
+    // path all along, so nothing has to be planned again. Safe to call from
+    // any thread.
+    void hold(float deceleration);
+    void resume();
+    bool isHeld() const { return _held.load(std::memory_order_acquire); }
+
+    // While held, drops every buffered event. MOVE_END markers still count as
+    // completed moves. Nothing may be rendered until flushPending() is false.
+    void requestFlush() { _flushRequested.store(true, std::memory_order_release); }
+    bool flushPending() const { return _flushRequested.load(std::memory_order_acquire); }
+
+private:
+    enum HoldState
+    {
+        HOLD_NONE,
+        HOLD_STOPPING,
+        HOLD_HELD,
+        HOLD_RESUMING
+    };
+
+    const StepEvent * dropBlockedSteps();
+    bool serviceHold();
+    unsigned long intervalOf(const StepEvent & event) const;
+    void updateHoldSpeed(unsigned long interval_InUS, unsigned long rendered_InUS);
+
+    StepBuffer & _buffer;
+    Gpio & _gpio;
+    Pins _pins;
+    bool _running;
+    uint32_t _directions;                       // STEP_EVENT_DIRECTION bits on the pins
+    bool _directionValid;
+    unsigned long _lastStepTime_InUS;
+
+    std::atomic<long> _positions[STEP_EVENT_AXES];
+    std::atomic<uint32_t> _completedMoves;
+    std::atomic<int32_t> _stepPeriod_InUS;     // negative while moving backwards
+    std::atomic<uint32_t> _blocked;
+    std::atomic<uint32_t> _droppedSteps;
+
+    HoldState _holdState;
+    float _holdSpeed;                           // steps/s while stopping or resuming
+    std::atomic<float> _holdAcceleration;       // steps/s^2
+    std::atomic<bool> _holdRequested;
+    std::atomic<bool> _held;
+    std::atomic<bool> _flushRequested;
+};
+
+typedef FixedStepPins<STEP_PIN, DIR_PIN, INVERT_DIR> ConfigStepPins;
+typedef BasicStepExecutor<RuntimeStepPins> DynamicStepExecutor;
+
+// The shield's executor. With FIXED_STEP_PINS the pins of Config.h are
+// compiled in, otherwise they are set by connectToPins() and connectAxis().
+#if FIXED_STEP_PINS
+typedef BasicStepExecutor<ConfigStepPins> StepExecutor;
+#else
+typedef DynamicStepExecutor StepExecutor;
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "StepBuffer.h"
+#include "Gpio.h"
+#include "Log.h"
+#include "Config.h"
+
+#include <stdint.h>
+
+// How the step executor turns the axis bits of a StepEvent into pin masks.
+// Both policies drive the step pins high to step. Direction pins are driven
+// high for negative moves, or low if the axis is inverted. AXES is how many
+// axes the executor has to keep positions for.
+
+// Pins given at run time, for setups that are only known once running
+class RuntimeStepPins
+{
+public:
+    static const int AXES = STEP_EVENT_AXES;
+
+    RuntimeStepPins()
+    {
+        for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        {
+            _stepMasks[axis] = 0;
+            _directionMasks[axis] = 0;
+            _inverted[axis] = false;
+        }
+    }
+
+    void connect(int axis, int stepPinNumber, int directionPinNumber, bool invertDirection)
+    {
+        _stepMasks[axis] = Gpio::maskOf(stepPinNumber);
+        _directionMasks[axis] = Gpio::maskOf(directionPinNumber);
+        _inverted[axis] = invertDirection;
+    }
+
+    uint32_t stepMask(uint32_t steps) const
+    {
+        uint32_t mask = 0;
+        for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        {
+            if(steps & (STEP_EVENT_STEP << axis))
+                mask |= _stepMasks[axis];
+        }
+        return mask;
+    }
+
+    void directionMasks(uint32_t directions, uint32_t & setMask, uint32_t & clearMask) const
+    {
+        setMask = 0;
+        clearMask = 0;
+        for(int axis = 0; axis < STEP_EVENT_AXES; axis++)
+        {
+            if(((directions & (STEP_EVENT_DIRECTION << axis)) != 0) != _inverted[axis])
+                setMask |= _directionMasks[axis];
+            else
+                clearMask |= _directionMasks[axis];
+        }
+    }
+
+private:
+    uint32_t _stepMasks[STEP_EVENT_AXES];
+    uint32_t _directionMasks[STEP_EVENT_AXES];
+    bool _inverted[STEP_EVENT_AXES];
+};
+
+// The masks of every combination of axes, indexed by the step or direction
+// bits of an event shifted down to bit 0
+struct StepPinMasks
+{
+    static const int COMBINATIONS = 1 << STEP_EVENT_AXES;
+
+    uint32_t step[COMBINATIONS];
+    uint32_t directionSet[COMBINATIONS];
+    uint32_t directionClear[COMBINATIONS];
+};
+
+template<int StepPin, int DirectionPin, bool InvertDirection>
+constexpr StepPinMasks buildStepPinMasks()
+{
+    StepPinMasks masks = {};
+    for(int bits = 0; bits < StepPinMasks::COMBINATIONS; bits++)
+    {
+        for(int axis = 0; axis <= AUX_AXIS_COUNT; axis++)
+        {
+            uint32_t stepMask = 1u << (axis == 0 ? StepPin : AUX_STEP_PINS[axis - 1]);
+            uint32_t directionMask = 1u << (axis == 0 ? DirectionPin : AUX_DIR_PINS[axis - 1]);
+            bool inverted = axis == 0 ? InvertDirection : AUX_INVERT_DIR[axis - 1];
+
+            if(bits & (1 << axis))
+                masks.step[bits] |= stepMask;
+            if(((bits & (1 << axis)) != 0) != inverted)
+                masks.directionSet[bits] |= directionMask;
+            else
+                masks.directionClear[bits] |= directionMask;
+        }
+    }
+    return masks;
+}
+
+// Z's pins and direction polarity as template arguments, the auxiliary axes'
+// from Config.h. The compiler builds every mask, so a step looks one up instead
+// of looping over the axes, and connect() only checks that it is given the
+// pins that were compiled in.
+template<int StepPin, int DirectionPin, bool InvertDirection>
+class FixedStepPins
+{
+public:
+    static_assert(StepPin >= 0 && StepPin < 32 && DirectionPin >= 0 && DirectionPin < 32, "Step pins must be in GPIO bank 0");
+
+    static const int AXES = AUX_AXIS_COUNT + 1;
+
+    void connect(int axis, int stepPinNumber, int directionPinNumber, bool invertDirection)
+    {
+        if(axis < 0 || axis >= AXES)
+        {
+            LOG_ERROR("Axis %d is not in Config.h, its step pin %d is not driven", axis, stepPinNumber);
+            return;
+        }
+
+        int step = axis == 0 ? StepPin : AUX_STEP_PINS[axis - 1];
+        int direction = axis == 0 ? DirectionPin : AUX_DIR_PINS[axis - 1];
+        bool inverted = axis == 0 ? InvertDirection : AUX_INVERT_DIR[axis - 1];
+        if(stepPinNumber != step || directionPinNumber != direction || invertDirection != inverted)
+        {
+            LOG_ERROR("Axis %d connected to step pin %d, direction pin %d%s, but FIXED_STEP_PINS drives %d, %d%s",
+                axis, stepPinNumber, directionPinNumber, invertDirection ? " inverted" : "",
+                step, direction, inverted ? " inverted" : "");
+        }
+    }
+
+    uint32_t stepMask(uint32_t steps) const
+    {
+        return MASKS.step[(steps & STEP_EVENT_STEPS) / STEP_EVENT_STEP];
+    }
+
+    void directionMasks(uint32_t directions, uint32_t & setMask, uint32_t & clearMask) const
+    {
+        uint32_t index = (directions & STEP_EVENT_DIRECTIONS) / STEP_EVENT_DIRECTION;
+        setMask = MASKS.directionSet[index];
+        clearMask = MASKS.directionClear[index];
+    }
+
+private:
+    static constexpr StepPinMasks MASKS = buildStepPinMasks<StepPin, DirectionPin, InvertDirection>();
+};
+
+template<int StepPin, int DirectionPin, bool InvertDirection>
+constexpr StepPinMasks FixedStepPins<StepPin, DirectionPin, InvertDirection>::MASKS;
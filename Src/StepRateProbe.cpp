@@ -0,0 +1,78 @@
+#include "StepRateProbe.h"
+#include "SpeedyStepper.h"
+#include "StepBuffer.h"
+#include "StepExecutor.h"
+#include "Config.h"
+
+#include <wiringPi.h>
+#include <limits.h>
+
+namespace
+{
+
+// Far above what any backend can step, reached within a few hundred steps
+const float PROBE_SPEED = 2000000;
+const float PROBE_ACCELERATION = 1e10;
+const long PROBE_STEPS = 20000;
+
+float stepsPerSecond(unsigned long elapsed_InUS)
+{
+    return PROBE_STEPS * 1e6f / (elapsed_InUS > 0 ? elapsed_InUS : 1);
+}
+
+float probeDirect()
+{
+    SpeedyStepper stepper;
+    stepper.connectToPins(STEP_PIN, DIR_PIN);
+    stepper.setSpeedInStepsPerSecond(PROBE_SPEED);
+    stepper.setAccelerationInStepsPerSecondPerSecond(PROBE_ACCELERATION);
+    stepper.setupRelativeMoveInSteps(PROBE_STEPS);
+
+    unsigned long start = micros();
+    while(!stepper.processMovement())
+        ;
+    return stepsPerSecond(micros() - start);
+}
+
+float probeBuffered(Gpio & gpio)
+{
+    SpeedyStepper stepper;
+    StepBuffer buffer;
+    StepExecutor executor(buffer, gpio);
+    executor.connectToPins(STEP_PIN, DIR_PIN);
+    stepper.setSpeedInStepsPerSecond(PROBE_SPEED);
+    stepper.setAccelerationInStepsPerSecondPerSecond(PROBE_ACCELERATION);
+    stepper.setupRelativeMoveInSteps(PROBE_STEPS);
+
+    // Render a full buffer, then play it back, timing both halves
+    unsigned long render_InUS = 0;
+    unsigned long execute_InUS = 0;
+    bool rendered = false;
+    while(!rendered)
+    {
+        unsigned long start = micros();
+        rendered = stepper.renderMovement(buffer, ULONG_MAX);
+        unsigned long middle = micros();
+        while(!executor.process())
+            ;
+        render_InUS += middle - start;
+        execute_InUS += micros() - middle;
+    }
+
+    // With the motion thread both halves run in parallel, otherwise in turn
+#if MOTION_THREAD
+    return stepsPerSecond(render_InUS > execute_InUS ? render_InUS : execute_InUS);
+#else
+    return stepsPerSecond(render_InUS + execute_InUS);
+#endif
+}
+
+}
+
+StepRateLimits probeStepRates(Gpio & gpio)
+{
+    StepRateLimits limits;
+    limits.bufferedStepsPerSecond = probeBuffered(gpio);
+    limits.directStepsPerSecond = probeDirect();
+    return limits;
+}
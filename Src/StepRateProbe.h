@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Gpio.h"
+
+// Highest step rates the two stepping paths reach on this machine, measured
+// by commanding a move far faster than either can go. Both are 0 until
+// measured. The probe pulses the step pin, so the driver must be disabled.
+struct StepRateLimits
+{
+    float bufferedStepsPerSecond;   // G1 moves, rendered and played back by the executor
+    float directStepsPerSecond;     // homing and buttons, stepped by SpeedyStepper::processMovement
+};
+
+StepRateLimits probeStepRates(Gpio & gpio);
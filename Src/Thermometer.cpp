@@ -0,0 +1,85 @@
+#include "Thermometer.h"
+#include "Log.h"
+
+#include <thread>
+#include <atomic>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <glob.h>
+#include <unistd.h>
+
+namespace
+{
+
+// DS18B20s have family code 28, the w1-gpio overlay lists them here
+const char * const SENSOR_PATTERN = "/sys/bus/w1/devices/28-*/w1_slave";
+const unsigned int READ_INTERVAL_S = 5;
+
+std::atomic<float> temperature(NAN);
+
+bool findSensor(char * path, size_t size)
+{
+    glob_t found;
+    bool ok = glob(SENSOR_PATTERN, 0, NULL, &found) == 0 && found.gl_pathc > 0;
+    if(ok)
+        snprintf(path, size, "%s", found.gl_pathv[0]);
+    globfree(&found);
+    return ok;
+}
+
+// The driver answers "... crc=xx YES" then "... t=23125" in millidegrees
+bool readSensor(const char * path, float & celsius)
+{
+    FILE * file = fopen(path, "r");
+    if(file == NULL)
+        return false;
+
+    char text[128];
+    size_t length = fread(text, 1, sizeof(text) - 1, file);
+    fclose(file);
+    text[length] = 0;
+
+    const char * value = strstr(text, "t=");
+    if(strstr(text, "YES") == NULL || value == NULL)
+        return false;
+
+    celsius = atoi(value + 2) / 1000.0f;
+    return true;
+}
+
+void runThermometer()
+{
+    char path[256];
+    bool found = false;
+    for(;;)
+    {
+        if(!found && (found = findSensor(path, sizeof(path))))
+            LOG_INFO("Thermometer found at %s", path);
+
+        float celsius;
+        if(found && readSensor(path, celsius))
+            temperature.store(celsius, std::memory_order_relaxed);
+        else
+        {
+            if(found)
+                LOG_WARN("Cannot read the thermometer");
+            found = false;
+            temperature.store(NAN, std::memory_order_relaxed);
+        }
+        sleep(READ_INTERVAL_S);
+    }
+}
+
+}
+
+void startThermometer()
+{
+    std::thread(runThermometer).detach();
+}
+
+float getTemperatureInCelsius()
+{
+    return temperature.load(std::memory_order_relaxed);
+}
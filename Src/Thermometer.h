@@ -0,0 +1,7 @@
+#pragma once
+
+// Reads the DS18B20 on the 1-Wire bus every few seconds on a thread of its
+// own, since the kernel driver takes 750ms per conversion. NAN until the
+// first good reading, and for as long as no sensor is found.
+void startThermometer();
+float getTemperatureInCelsius();
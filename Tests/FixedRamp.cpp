@@ -0,0 +1,9 @@
+// SpeedyStepper with the fixed-point ramp, renamed so it links next to the float one
+#include "Config.h"
+
+#undef RAMP_FIXED_POINT
+#define RAMP_FIXED_POINT 1
+#define SpeedyStepper FixedRampStepper
+#define RAMP_RENDER_FUNCTION renderFixedRamp
+
+#include "RampVariant.h"
@@ -0,0 +1,9 @@
+// SpeedyStepper with the float ramp, renamed so it links next to the fixed-point one
+#include "Config.h"
+
+#undef RAMP_FIXED_POINT
+#define RAMP_FIXED_POINT 0
+#define SpeedyStepper FloatRampStepper
+#define RAMP_RENDER_FUNCTION renderFloatRamp
+
+#include "RampVariant.h"
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// SpeedyStepper is compiled twice, once with each acceleration ramp
+// (FloatRamp.cpp and FixedRamp.cpp), so one program can render the same
+// move with both and compare or time them.
+
+struct RampMove
+{
+    long distance;          // steps
+    float speed;            // steps/s
+    float acceleration;     // steps/s^2
+    float entrySpeed;
+    float exitSpeed;
+};
+
+// Renders the whole move and returns its number of steps. The interval of
+// every step is appended to intervals unless it is NULL.
+size_t renderFloatRamp(const RampMove & move, std::vector<uint32_t> * intervals);
+size_t renderFixedRamp(const RampMove & move, std::vector<uint32_t> * intervals);
@@ -0,0 +1,98 @@
+#include "RampRender.h"
+#include "Config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Renders a grid of moves with the float and the fixed-point ramp and checks
+// that the step timelines agree within the tolerances stated in Config.h
+
+namespace
+{
+
+// Close to rest the Leib recursion amplifies any rounding, in either ramp, so
+// the last steps of a move get a looser per-step tolerance. The worst seen is
+// 66us, on the very last step of a move.
+const size_t TAIL_STEPS = 300;
+const long STEP_TOLERANCE_US = 1;
+const long TAIL_STEP_TOLERANCE_US = 100;
+const double CUMULATIVE_TOLERANCE = 0.0025;
+
+const float SPEEDS[] = { 0.5f, 2, 5, 10, 20 };                  // mm/s
+const float ACCELERATIONS[] = { 5, 50, 500, 5000 };             // mm/s^2
+const float DISTANCES[] = { 0.01f, 0.5f, 5, 20 };               // mm
+
+bool compareMove(const RampMove & move)
+{
+    std::vector<uint32_t> floatIntervals;
+    std::vector<uint32_t> fixedIntervals;
+    renderFloatRamp(move, &floatIntervals);
+    renderFixedRamp(move, &fixedIntervals);
+
+    if(floatIntervals.size() != fixedIntervals.size())
+    {
+        printf("%ld steps at %.0f steps/s, %.0f steps/s^2: %zu steps with the float ramp, %zu with fixed point\n",
+            move.distance, move.speed, move.acceleration, floatIntervals.size(), fixedIntervals.size());
+        return false;
+    }
+
+    long long floatTime = 0;
+    long long fixedTime = 0;
+    size_t count = floatIntervals.size();
+    for(size_t i = 0; i < count; i++)
+    {
+        long difference = labs((long)floatIntervals[i] - (long)fixedIntervals[i]);
+        long tolerance = i + TAIL_STEPS < count ? STEP_TOLERANCE_US : TAIL_STEP_TOLERANCE_US;
+        if(difference > tolerance)
+        {
+            printf("%ld steps at %.0f steps/s, %.0f steps/s^2: step %zu takes %u us with the float ramp, %u with fixed point\n",
+                move.distance, move.speed, move.acceleration, i, floatIntervals[i], fixedIntervals[i]);
+            return false;
+        }
+        floatTime += floatIntervals[i];
+        fixedTime += fixedIntervals[i];
+    }
+
+    if(llabs(floatTime - fixedTime) > CUMULATIVE_TOLERANCE * floatTime)
+    {
+        printf("%ld steps at %.0f steps/s, %.0f steps/s^2: %lld us with the float ramp, %lld with fixed point\n",
+            move.distance, move.speed, move.acceleration, floatTime, fixedTime);
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main()
+{
+    int moves = 0;
+    int failures = 0;
+    for(float speed : SPEEDS)
+    {
+        for(float acceleration : ACCELERATIONS)
+        {
+            for(float distance : DISTANCES)
+            {
+                // From rest to rest, and blended into neighbouring moves
+                for(int blended = 0; blended < 2; blended++)
+                {
+                    RampMove move;
+                    move.distance = lround(distance * STEPS_PER_MM);
+                    move.speed = speed * STEPS_PER_MM;
+                    move.acceleration = acceleration * STEPS_PER_MM;
+                    move.entrySpeed = blended ? move.speed / 2 : 0;
+                    move.exitSpeed = blended ? move.speed / 4 : 0;
+
+                    moves++;
+                    if(!compareMove(move))
+                        failures++;
+                }
+            }
+        }
+    }
+
+    printf("%d of %d moves match\n", moves - failures, moves);
+    return failures == 0 ? 0 : 1;
+}
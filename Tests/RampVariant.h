@@ -0,0 +1,35 @@
+// Included by FloatRamp.cpp and FixedRamp.cpp once they have picked
+// RAMP_FIXED_POINT, renamed SpeedyStepper and named RAMP_RENDER_FUNCTION
+
+#include "../Src/SpeedyStepper.cpp"
+#include "RampRender.h"
+
+size_t RAMP_RENDER_FUNCTION(const RampMove & move, std::vector<uint32_t> * intervals)
+{
+    SpeedyStepper stepper;
+    StepBuffer buffer;
+    stepper.setCurrentPositionInSteps(0);
+    stepper.setSpeedInStepsPerSecond(move.speed);
+    stepper.setAccelerationInStepsPerSecondPerSecond(move.acceleration);
+    stepper.setJerkInStepsPerSecondPerSecondPerSecond(0);
+    stepper.setupMoveInSteps(move.distance, move.entrySpeed, move.exitSpeed);
+
+    size_t steps = 0;
+    bool finished;
+    do
+    {
+        finished = stepper.renderMovement(buffer, 0xFFFFFFFFul);
+        for(const StepEvent * event = buffer.front(); event != NULL; event = buffer.front())
+        {
+            if(!(event->flags & STEP_EVENT_MOVE_END))
+            {
+                if(intervals != NULL)
+                    intervals->push_back(event->intervalInUS);
+                steps++;
+            }
+            buffer.pop();
+        }
+    } while(!finished);
+
+    return steps;
+}
@@ -0,0 +1,152 @@
+#include "SpeedyStepper.h"
+#include "StepBuffer.h"
+#include "Config.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+// Stops S-curve moves at points through their acceleration and cruise and
+// checks that the stop is jerk-limited: the jerk measured from the rendered
+// step times stays at the configured jerk, and the move comes to rest.
+
+namespace
+{
+
+// The jerk is measured over windows of steps, which smooths the rounding of
+// the step times to whole microseconds. Switching straight from accelerating
+// to decelerating measures well over twice the jerk.
+const double JERK_TOLERANCE = 1.25;
+
+// The last step of a move that comes to rest is far slower than its cruise
+const double REST_SPEED = 0.01;
+
+struct StopProfile
+{
+    float speed;            // mm/s
+    float distance;         // mm
+    float jerk;             // mm/s^3
+    float acceleration;     // mm/s^2
+    size_t window;          // steps per velocity estimate
+};
+
+// Without and with a phase at peak acceleration
+const StopProfile PROFILES[] =
+{
+    { 2, 5, 1000, 50, 600 },
+    { 20, 20, 20000, 600, 2048 },
+};
+
+const long STOP_STEPS[] = { 1, 300, 1000, 2000, 3000, 4000, 6000, 9000 };
+
+// Renders the move, calling setupStop() once stopStep steps are rendered,
+// and returns the time of every step in seconds
+std::vector<double> renderStoppedMove(const StopProfile & profile, long stopStep, long & reached)
+{
+    SpeedyStepper stepper;
+    StepBuffer buffer;
+    stepper.setCurrentPositionInSteps(0);
+    stepper.setSpeedInStepsPerSecond(profile.speed * STEPS_PER_MM);
+    stepper.setAccelerationInStepsPerSecondPerSecond(profile.acceleration * STEPS_PER_MM);
+    stepper.setJerkInStepsPerSecondPerSecondPerSecond(profile.jerk * STEPS_PER_MM);
+    stepper.setupMoveInSteps(lround(profile.distance * STEPS_PER_MM));
+
+    std::vector<double> times;
+    double now = 0;
+    bool stopped = false;
+    bool finished;
+    do
+    {
+        if(!stopped && (long)times.size() == stopStep)
+        {
+            stepper.setupStop();
+            stopped = true;
+        }
+
+        // One step per call, so the stop lands on the step asked for
+        finished = stepper.renderMovement(buffer, 1);
+        for(const StepEvent * event = buffer.front(); event != NULL; event = buffer.front())
+        {
+            if(!(event->flags & STEP_EVENT_MOVE_END))
+            {
+                now += event->intervalInUS * 1e-6;
+                times.push_back(now);
+            }
+            buffer.pop();
+        }
+    } while(!finished);
+
+    reached = stepper.getCurrentPositionInSteps();
+    return times;
+}
+
+double maxJerk(const std::vector<double> & times, size_t window)
+{
+    std::vector<double> velocities, velocityTimes;
+    for(size_t i = 0; i + window < times.size(); i += window / 4)
+    {
+        velocities.push_back(window / (times[i + window] - times[i]));
+        velocityTimes.push_back((times[i + window] + times[i]) / 2);
+    }
+
+    std::vector<double> accelerations, accelerationTimes;
+    for(size_t i = 0; i + 4 < velocities.size(); i++)
+    {
+        accelerations.push_back((velocities[i + 4] - velocities[i]) / (velocityTimes[i + 4] - velocityTimes[i]));
+        accelerationTimes.push_back((velocityTimes[i + 4] + velocityTimes[i]) / 2);
+    }
+
+    double jerk = 0;
+    for(size_t i = 0; i + 4 < accelerations.size(); i++)
+        jerk = fmax(jerk, fabs(accelerations[i + 4] - accelerations[i]) / (accelerationTimes[i + 4] - accelerationTimes[i]));
+    return jerk;
+}
+
+bool checkStop(const StopProfile & profile, long stopStep)
+{
+    long reached;
+    std::vector<double> times = renderStoppedMove(profile, stopStep, reached);
+
+    if((long)times.size() != reached || times.size() < 2)
+    {
+        printf("%g mm/s, stop at step %ld: position %ld after %zu steps\n",
+            profile.speed, stopStep, reached, times.size());
+        return false;
+    }
+
+    double lastSpeed = 1 / (times.back() - times[times.size() - 2]) / STEPS_PER_MM;
+    if(lastSpeed > REST_SPEED * profile.speed)
+    {
+        printf("%g mm/s, stop at step %ld: last step at %.3f mm/s\n", profile.speed, stopStep, lastSpeed);
+        return false;
+    }
+
+    double jerk = maxJerk(times, profile.window) / STEPS_PER_MM;
+    if(jerk > JERK_TOLERANCE * profile.jerk)
+    {
+        printf("%g mm/s, stop at step %ld: jerk reaches %.0f mm/s^3, configured %g mm/s^3\n",
+            profile.speed, stopStep, jerk, profile.jerk);
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main()
+{
+    int stops = 0;
+    int failures = 0;
+    for(const StopProfile & profile : PROFILES)
+    {
+        for(long stopStep : STOP_STEPS)
+        {
+            stops++;
+            if(!checkStop(profile, stopStep))
+                failures++;
+        }
+    }
+
+    printf("%d of %d stops are jerk-limited\n", stops - failures, stops);
+    return failures == 0 ? 0 : 1;
+}